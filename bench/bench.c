@@ -0,0 +1,269 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Hosted microbenchmarks for kernel/string.c and kernel/vsnprintf.c.
+ *
+ * usage: kbench [generic|sse2|avx2] [quick]
+ *
+ * Every kernel routine is timed against its glibc counterpart across
+ * sizes from 1 byte to 1 MiB and several source/destination alignments.
+ */
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <kernel/cpu.h>
+#include <kernel/fpu.h>
+#include <kernel/lib/string.h>
+
+#define MAX_SIZE    (1024 * 1024)
+#define BUF_SIZE    (MAX_SIZE + 4096)
+#define TARGET_BYTES (256ULL * 1024 * 1024)
+#define MIN_ITERS   64
+#define FMT_ITERS   200000
+
+int kernel_vsnprintf(char *out, size_t out_sz, const char *fmt, va_list args);
+
+static const size_t alignments[] = { 0, 1, 7 };
+#define NR_ALIGN (sizeof(alignments) / sizeof(alignments[0]))
+
+static uint8_t *src_buf;
+static uint8_t *dst_buf;
+static bool quick;
+static volatile int sink;
+
+/* Called through volatile pointers so gcc cannot inline or elide glibc */
+static void *(*volatile libc_memcpy)(void *, const void *, size_t) = memcpy;
+static void *(*volatile libc_memset)(void *, int, size_t) = memset;
+static int (*volatile libc_memcmp)(const void *, const void *, size_t) = memcmp;
+static size_t (*volatile libc_strlen)(const char *) = strlen;
+static int (*volatile libc_strcmp)(const char *, const char *) = strcmp;
+
+/* Userspace owns its vector registers outright */
+bool kernel_fpu_begin(void)
+{
+    return true;
+}
+
+void kernel_fpu_end(void)
+{
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static size_t iterations(size_t size)
+{
+    uint64_t iters = TARGET_BYTES / size;
+    if (quick) iters /= 16;
+    if (iters < MIN_ITERS) iters = MIN_ITERS;
+    if (iters > 4000000) iters = 4000000;
+    return (size_t)iters;
+}
+
+enum op {
+    OP_MEMCPY,
+    OP_MEMSET,
+    OP_MEMCMP,
+    OP_STRLEN,
+    OP_STRCMP,
+};
+
+static const char *const op_names[] = { "memcpy", "memset", "memcmp", "strlen", "strcmp" };
+
+/* Time one (op, size, alignment) pair; returns ns per call */
+static double run_op(enum op op, bool kernel, size_t size, size_t align)
+{
+    uint8_t *d = dst_buf + align;
+    uint8_t *s = src_buf + (align ? 64 - align : 0);
+    size_t iters = iterations(size);
+    int acc = 0;
+
+    /* String ops need NUL-terminated inputs of exactly size - 1 chars */
+    if (op == OP_STRLEN || op == OP_STRCMP) {
+        memset(s, 'a', size);
+        s[size - 1] = '\0';
+        memcpy(d, s, size);
+    } else if (op == OP_MEMCMP) {
+        memcpy(d, s, size);
+    }
+
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < iters; i++) {
+        switch (op) {
+            case OP_MEMCPY:
+                if (kernel) k_memcpy(d, s, size);
+                else libc_memcpy(d, s, size);
+                break;
+            case OP_MEMSET:
+                if (kernel) k_memset(d, (uint8_t)i, size);
+                else libc_memset(d, (int)(uint8_t)i, size);
+                break;
+            case OP_MEMCMP:
+                acc += kernel ? k_memcmp(d, s, size) : libc_memcmp(d, s, size);
+                break;
+            case OP_STRLEN:
+                acc += (int)(kernel ? k_strlen((const char *)s) : libc_strlen((const char *)s));
+                break;
+            case OP_STRCMP:
+                acc += kernel ? k_strcmp((const char *)d, (const char *)s)
+                              : libc_strcmp((const char *)d, (const char *)s);
+                break;
+        }
+    }
+    uint64_t elapsed = now_ns() - start;
+    sink += acc;
+    return (double)elapsed / (double)iters;
+}
+
+static void bench_op(enum op op)
+{
+    printf("\n%s\n", op_names[op]);
+    printf("%9s %5s | %10s %8s | %10s %8s | %6s\n",
+           "size", "align", "kernel ns", "GB/s", "glibc ns", "GB/s", "ratio");
+
+    for (size_t size = 1; size <= MAX_SIZE; size *= 2) {
+        /* Also cover the odd sizes that hit the tail handling */
+        size_t sizes[2] = { size, size * 3 / 2 + 1 };
+        for (int k = 0; k < 2; k++) {
+            size_t sz = sizes[k];
+            if (sz > MAX_SIZE || (k && size < 4)) continue;
+            for (size_t a = 0; a < NR_ALIGN; a++) {
+                double kns = run_op(op, true, sz, alignments[a]);
+                double gns = run_op(op, false, sz, alignments[a]);
+                printf("%9zu %5zu | %10.2f %8.2f | %10.2f %8.2f | %6.2f\n",
+                       sz, alignments[a], kns, sz / kns, gns, sz / gns, gns / kns);
+            }
+        }
+    }
+}
+
+static int fmt_kernel(char *out, size_t sz, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int n = kernel_vsnprintf(out, sz, fmt, args);
+    va_end(args);
+    return n;
+}
+
+struct fmt_case {
+    const char *name;
+    const char *fmt;
+};
+
+static const struct fmt_case fmt_cases[] = {
+    { "int",     "%d" },
+    { "uint64",  "%lu" },
+    { "hex",     "%lx" },
+    { "string",  "%s" },
+    { "logline", "cpu%u: irq %d took %lu cycles at %p (%s)\n" },
+};
+
+static double run_fmt(const struct fmt_case *fc, bool kernel)
+{
+    char out[256];
+    size_t iters = quick ? FMT_ITERS / 16 : FMT_ITERS;
+    int acc = 0;
+
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < iters; i++) {
+        unsigned int u = (unsigned int)i * 2654435761u;
+        uint64_t big = (uint64_t)u * 0x9E3779B97F4A7C15ULL;
+        const char *name = "serial";
+        int n;
+        if (fc->fmt[1] == 'd') {
+            n = kernel ? fmt_kernel(out, sizeof(out), fc->fmt, (int)u)
+                       : snprintf(out, sizeof(out), fc->fmt, (int)u);
+        } else if (fc->fmt[1] == 'l') {
+            n = kernel ? fmt_kernel(out, sizeof(out), fc->fmt, big)
+                       : snprintf(out, sizeof(out), fc->fmt, big);
+        } else if (fc->fmt[1] == 's') {
+            n = kernel ? fmt_kernel(out, sizeof(out), fc->fmt, name)
+                       : snprintf(out, sizeof(out), fc->fmt, name);
+        } else {
+            n = kernel ? fmt_kernel(out, sizeof(out), fc->fmt, u & 15, (int)u, big, (void *)(uintptr_t)big, name)
+                       : snprintf(out, sizeof(out), fc->fmt, u & 15, (int)u, big, (void *)(uintptr_t)big, name);
+        }
+        acc += n + out[0];
+    }
+    uint64_t elapsed = now_ns() - start;
+    sink += acc;
+    return (double)elapsed / (double)iters;
+}
+
+static void bench_fmt(void)
+{
+    printf("\nvsnprintf\n");
+    printf("%9s | %10s | %10s | %6s\n", "format", "kernel ns", "glibc ns", "ratio");
+    for (size_t i = 0; i < sizeof(fmt_cases) / sizeof(fmt_cases[0]); i++) {
+        double kns = run_fmt(&fmt_cases[i], true);
+        double gns = run_fmt(&fmt_cases[i], false);
+        printf("%9s | %10.2f | %10.2f | %6.2f\n", fmt_cases[i].name, kns, gns, gns / kns);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    cpu_init();
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "quick")) {
+            quick = true;
+        } else if (!strcmp(argv[i], "generic")) {
+            cpu_features.sse2 = cpu_features.avx2 = false;
+            cpu_features.erms = cpu_features.fsrm = false;
+        } else if (!strcmp(argv[i], "sse2")) {
+            cpu_features.avx2 = false;
+            cpu_features.erms = cpu_features.fsrm = false;
+        } else if (!strcmp(argv[i], "avx2")) {
+            cpu_features.erms = cpu_features.fsrm = false;
+        } else {
+            fprintf(stderr, "usage: %s [generic|sse2|avx2] [quick]\n", argv[0]);
+            return 1;
+        }
+    }
+    k_string_init();
+
+    src_buf = aligned_alloc(4096, BUF_SIZE);
+    dst_buf = aligned_alloc(4096, BUF_SIZE);
+    if (!src_buf || !dst_buf) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    for (size_t i = 0; i < BUF_SIZE; i++) src_buf[i] = (uint8_t)(i * 131 + 7);
+    memset(dst_buf, 0, BUF_SIZE);
+
+    printf("kernel string variant: %s\n", k_string_variant());
+    for (int op = OP_MEMCPY; op <= OP_STRCMP; op++) {
+        bench_op((enum op)op);
+    }
+    bench_fmt();
+    return 0;
+}
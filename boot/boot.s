@@ -17,6 +17,8 @@
 ; along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ;
 
+KERNEL_VMA equ 0xFFFFFFFF80000000 ; must match linker.ld
+
 section .multiboot2
 header_start:
     dd 0xe85250d6
@@ -52,6 +54,8 @@ pml4_table:
     resb 4096
 pdpt_table:
     resb 4096
+pdpt_high_table:
+    resb 4096
 pd_table:
     resb 4096 * 4
 
@@ -68,30 +72,34 @@ gdt64:
     dq 0x0020920000000000
 gdt64_len: equ $ - gdt64
 
+; Loaded first with the physical base, rewritten in 64-bit code
 gdtr64:
     dw gdt64_len - 1
-    dq gdt64
+    dq gdt64 - KERNEL_VMA
 
 global multiboot2_info_addr
 multiboot2_info_addr: dq 0
 
-section .text
+; Runs from its load address until the jump to the higher half, so every
+; kernel symbol it touches is converted to a physical address
+section .boot progbits alloc exec nowrite align=16
 bits 32
 global boot_start
 
 boot_start:
-    mov dword [multiboot2_info_addr], ebx
-    mov dword [multiboot2_info_addr + 4], 0
+    mov dword [multiboot2_info_addr - KERNEL_VMA], ebx
+    mov dword [multiboot2_info_addr - KERNEL_VMA + 4], 0
 
-    mov esp, stack_top
+    mov esp, stack_top - KERNEL_VMA
     jmp .goto_long_mode
 
 .goto_long_mode:
     call setup_paging
+    call setup_simd
     mov eax, cr4
     or eax, 1 << 5
     mov cr4, eax
-    mov eax, pml4_table
+    mov eax, pml4_table - KERNEL_VMA
     mov cr3, eax
     mov ecx, 0xC0000080
     rdmsr
@@ -100,30 +108,42 @@ boot_start:
     mov eax, cr0
     or eax, 1 << 31
     mov cr0, eax
-    lgdt [gdtr64]
-    jmp 0x08:kernel_entry
+    lgdt [gdtr64 - KERNEL_VMA]
+    jmp 0x08:long_mode_entry
 
 setup_paging:
     push edi
     push esi
-    mov edi, pml4_table
-    mov ecx, (4096 * 6) / 4
+    mov edi, pml4_table - KERNEL_VMA
+    mov ecx, (4096 * 7) / 4
     xor eax, eax
     rep stosd
-    mov eax, pdpt_table
+    ; slot 0: identity, slot 256: PAGE_OFFSET, both the first 4 GiB
+    mov eax, pdpt_table - KERNEL_VMA
+    or eax, 0x03
+    mov [pml4_table - KERNEL_VMA], eax
+    mov [pml4_table - KERNEL_VMA + 256 * 8], eax
+    mov eax, pd_table - KERNEL_VMA
+    or eax, 0x03
+    mov [pdpt_table - KERNEL_VMA + 0 * 8], eax
+    add eax, 4096
+    mov [pdpt_table - KERNEL_VMA + 1 * 8], eax
+    add eax, 4096
+    mov [pdpt_table - KERNEL_VMA + 2 * 8], eax
+    add eax, 4096
+    mov [pdpt_table - KERNEL_VMA + 3 * 8], eax
+    ; slot 511: the kernel image, the first 2 GiB at KERNEL_VMA
+    mov eax, pdpt_high_table - KERNEL_VMA
     or eax, 0x03
-    mov [pml4_table], eax
-    mov [pml4_table + 256 * 8], eax
-    mov [pml4_table + 511 * 8], eax
-    mov eax, pd_table
+    mov [pml4_table - KERNEL_VMA + 511 * 8], eax
+    mov eax, pd_table - KERNEL_VMA
     or eax, 0x03
-    mov [pdpt_table + 0 * 8], eax
-    mov [pdpt_table + 1 * 8], eax
-    mov [pdpt_table + 2 * 8], eax
-    mov [pdpt_table + 3 * 8], eax
+    mov [pdpt_high_table - KERNEL_VMA + 510 * 8], eax
+    add eax, 4096
+    mov [pdpt_high_table - KERNEL_VMA + 511 * 8], eax
     mov eax, 0x00000083
     mov ecx, 2048
-    mov edi, pd_table
+    mov edi, pd_table - KERNEL_VMA
 .set_pd_entries:
     mov [edi], eax
     mov dword [edi + 4], 0
@@ -134,9 +154,51 @@ setup_paging:
     pop edi
     ret
 
+setup_simd:
+    push ebx
+    mov eax, cr0
+    and eax, ~(1 << 2)              ; clear CR0.EM
+    or eax, 1 << 1                  ; set CR0.MP
+    mov cr0, eax
+    fninit
+    mov eax, cr4
+    or eax, (1 << 9) | (1 << 10)    ; CR4.OSFXSR | CR4.OSXMMEXCPT
+    mov cr4, eax
+    mov eax, 1
+    cpuid
+    test ecx, 1 << 26               ; XSAVE supported?
+    jz .done
+    mov eax, cr4
+    or eax, 1 << 18                 ; CR4.OSXSAVE
+    mov cr4, eax
+    mov eax, 0x03                   ; XCR0: x87 | SSE
+    test ecx, 1 << 28               ; AVX supported?
+    jz .set_xcr0
+    or eax, 0x04                    ; XCR0: AVX
+.set_xcr0:
+    xor edx, edx
+    xor ecx, ecx
+    xsetbv
+.done:
+    pop ebx
+    ret
+
 bits 64
 
+long_mode_entry:
+    mov rax, kernel_entry
+    jmp rax
+
+section .text
+
+; Now running at KERNEL_VMA: move the GDT base up and drop the identity map
 kernel_entry:
+    mov rax, gdt64
+    mov [rel gdtr64 + 2], rax
+    lgdt [rel gdtr64]
+    mov qword [rel pml4_table], 0
+    mov rax, cr3
+    mov cr3, rax
     mov ax, 0x10
     mov ds, ax
     mov es, ax
@@ -144,8 +206,22 @@ kernel_entry:
     mov gs, ax
     mov ss, ax
     mov rsp, stack_top
+    ; GS points at the boot CPU's per-CPU area before any C code runs
+    extern percpu_load, percpu_end, percpu_boot_area, percpu_offset, this_cpu_off
+    mov rsi, percpu_load
+    mov rdi, percpu_boot_area
+    mov rcx, percpu_end
+    rep movsb
+    mov rax, percpu_boot_area
+    mov rdx, rax
+    shr rdx, 32
+    mov ecx, 0xC0000101             ; IA32_GS_BASE
+    wrmsr
+    mov rax, percpu_boot_area
+    mov [gs:this_cpu_off], rax
+    mov [rel percpu_offset], rax
     extern main
-    mov rdi, [multiboot2_info_addr]
+    mov rdi, [rel multiboot2_info_addr]
     call main
     hlt
     jmp $
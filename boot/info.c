@@ -19,7 +19,9 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 #include <boot/info.h>
+#include <kernel/paging.h>
 
 extern uint64_t multiboot2_info_addr;
 
@@ -28,36 +30,81 @@ struct multiboot2_info *mbi;
 uint8_t *current_tag;
 struct multiboot2_tag *tag;
 struct multiboot2_tag_framebuffer *fb_info;
+const char *mb_cmdline = "";
+struct multiboot2_tag_mmap *mb_mmap;
+const void *mb_acpi_rsdp;
 
 void parse_mb_info()
 {
-    mbi = (struct multiboot2_info *)multiboot2_info_addr;
+    mbi = phys_to_virt(multiboot2_info_addr);
     current_tag = mbi->tags;
     uint8_t *mb_end = (uint8_t *)mbi + mbi->total_size;
 
+    // fallback to text mode
+    is_graphics_mode = 0;
+
     while (current_tag + sizeof(struct multiboot2_tag) <= mb_end) {
         tag = (struct multiboot2_tag *)current_tag;
 
         // validate tag size
-        if (tag->size == 0) break;
+        if (tag->size == 0 || tag->type == MB2_TAG_END) break;
+        if ((uint8_t *)tag + tag->size > mb_end) break;
 
-        // find framebuffer tag (8)
-        if (tag->type == 8) {
-            if ((uint8_t *)tag + tag->size > mb_end) break;
+        switch (tag->type) {
+            case MB2_TAG_CMDLINE:
+                mb_cmdline = ((struct multiboot2_tag_string *)tag)->string;
+                break;
+            case MB2_TAG_MMAP:
+                mb_mmap = (struct multiboot2_tag_mmap *)tag;
+                break;
+            case MB2_TAG_ACPI_OLD:
+                if (!mb_acpi_rsdp) mb_acpi_rsdp = ((struct multiboot2_tag_acpi *)tag)->rsdp;
+                break;
+            case MB2_TAG_ACPI_NEW:
+                // the XSDT one wins over an RSDT-only copy
+                mb_acpi_rsdp = ((struct multiboot2_tag_acpi *)tag)->rsdp;
+                break;
+            case MB2_TAG_FRAMEBUFFER:
+                fb_info = (struct multiboot2_tag_framebuffer *)tag;
 
-            fb_info = (struct multiboot2_tag_framebuffer *)tag;
-
-            if (fb_info->fb_width > 80 || fb_info->fb_height > 25 || fb_info->fb_bpp > 16) {
-                is_graphics_mode = 1;
-            } else {
-                is_graphics_mode = 0;
-            }
-            return;
+                if (fb_info->fb_width > 80 || fb_info->fb_height > 25 || fb_info->fb_bpp > 16) {
+                    is_graphics_mode = 1;
+                } else {
+                    is_graphics_mode = 0;
+                }
+                break;
         }
 
         current_tag += (tag->size + 7) & ~7;
     }
+}
 
-    // fallback to text mode
-    is_graphics_mode = 0;
+/*
+ * Look up "name" or "name=value" in the boot command line. On a match the
+ * value (empty for a bare flag) is copied into buf, truncated to size - 1.
+ */
+bool mb_cmdline_get(const char *name, char *buf, size_t size)
+{
+    const char *p = mb_cmdline;
+
+    while (*p) {
+        while (*p == ' ') p++;
+
+        const char *n = name;
+        while (*n && *p == *n) { p++; n++; }
+
+        if (!*n && (*p == '=' || *p == ' ' || *p == '\0')) {
+            size_t len = 0;
+            if (*p == '=') {
+                for (p++; *p && *p != ' '; p++) {
+                    if (len + 1 < size) buf[len++] = *p;
+                }
+            }
+            if (size) buf[len] = '\0';
+            return true;
+        }
+
+        while (*p && *p != ' ') p++;
+    }
+    return false;
 }
\ No newline at end of file
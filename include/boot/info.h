@@ -21,6 +21,18 @@
 #define INFO_H
 
 #include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define MB2_TAG_END         0
+#define MB2_TAG_CMDLINE     1
+#define MB2_TAG_MMAP        6
+#define MB2_TAG_FRAMEBUFFER 8
+#define MB2_TAG_ACPI_OLD    14
+#define MB2_TAG_ACPI_NEW    15
+
+#define MB2_FB_TYPE_RGB     1
+#define MB2_MMAP_AVAILABLE  1
 
 struct multiboot2_tag
 {
@@ -28,6 +40,30 @@ struct multiboot2_tag
     uint32_t size;
 };
 
+struct multiboot2_tag_string
+{
+    uint32_t type;
+    uint32_t size;
+    char string[];
+};
+
+struct multiboot2_mmap_entry
+{
+    uint64_t addr;
+    uint64_t len;
+    uint32_t type;
+    uint32_t zero;
+};
+
+struct multiboot2_tag_mmap
+{
+    uint32_t type;
+    uint32_t size;
+    uint32_t entry_size;
+    uint32_t entry_version;
+    uint8_t entries[];
+};
+
 struct multiboot2_tag_framebuffer
 {
     uint32_t type;
@@ -38,7 +74,22 @@ struct multiboot2_tag_framebuffer
     uint32_t fb_height;
     uint8_t fb_bpp;
     uint8_t fb_type;
-    uint8_t reserved;
+    uint16_t reserved;
+    // direct RGB colour info, valid when fb_type == MB2_FB_TYPE_RGB
+    uint8_t red_pos;
+    uint8_t red_size;
+    uint8_t green_pos;
+    uint8_t green_size;
+    uint8_t blue_pos;
+    uint8_t blue_size;
+};
+
+// A copy of the ACPI RSDP (version 1 or 2)
+struct multiboot2_tag_acpi
+{
+    uint32_t type;
+    uint32_t size;
+    uint8_t rsdp[];
 };
 
 struct multiboot2_info
@@ -55,5 +106,10 @@ extern struct multiboot2_info *mbi;
 extern uint8_t *current_tag;
 extern struct multiboot2_tag *tag;
 extern struct multiboot2_tag_framebuffer *fb_info;
+extern const char *mb_cmdline;
+extern struct multiboot2_tag_mmap *mb_mmap;
+extern const void *mb_acpi_rsdp;
+
+bool mb_cmdline_get(const char *name, char *buf, size_t size);
 
 #endif
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ACPI_H
+#define ACPI_H
+
+#include <stdint.h>
+
+struct acpi_sdt_header {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed));
+
+// MADT ("APIC") and the entry types the kernel uses
+#define MADT_LAPIC       0  // one per processor
+#define MADT_IOAPIC      1
+#define MADT_ISO         2  // ISA interrupt source override
+#define MADT_LAPIC_ADDR  5  // 64-bit local APIC address
+
+struct acpi_madt {
+    struct acpi_sdt_header header;
+    uint32_t lapic_addr;
+    uint32_t flags;
+    uint8_t entries[];
+} __attribute__((packed));
+
+struct madt_entry {
+    uint8_t type;
+    uint8_t length;
+} __attribute__((packed));
+
+#define MADT_LAPIC_ENABLED        (1 << 0)
+#define MADT_LAPIC_ONLINE_CAPABLE (1 << 1)
+
+struct madt_lapic {
+    struct madt_entry entry;
+    uint8_t acpi_id;
+    uint8_t apic_id;
+    uint32_t flags;
+} __attribute__((packed));
+
+struct madt_ioapic {
+    struct madt_entry entry;
+    uint8_t id;
+    uint8_t reserved;
+    uint32_t addr;
+    uint32_t gsi_base;
+} __attribute__((packed));
+
+struct madt_iso {
+    struct madt_entry entry;
+    uint8_t bus;
+    uint8_t source;
+    uint32_t gsi;
+    uint16_t flags;
+} __attribute__((packed));
+
+struct madt_lapic_addr {
+    struct madt_entry entry;
+    uint16_t reserved;
+    uint64_t addr;
+} __attribute__((packed));
+
+// Generic address structure
+struct acpi_gas {
+    uint8_t space_id;   // 0: memory, 1: I/O ports
+    uint8_t bit_width;
+    uint8_t bit_offset;
+    uint8_t access_size;
+    uint64_t address;
+} __attribute__((packed));
+
+struct acpi_hpet {
+    struct acpi_sdt_header header;
+    uint32_t block_id;
+    struct acpi_gas address;
+    uint8_t number;
+    uint16_t min_tick;
+    uint8_t page_protection;
+} __attribute__((packed));
+
+void acpi_init(void);
+const struct acpi_sdt_header *acpi_find_table(const char *signature);
+
+#endif
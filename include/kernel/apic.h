@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef APIC_H
+#define APIC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define IRQ_VECTOR_BASE 0x30  // ISA IRQ n arrives on vector 0x30 + n through the IOAPIC
+#define TLB_VECTOR      0xED  // IPI: flush TLB entries, see vmm.c
+#define RESCHED_VECTOR  0xEE  // IPI: run the scheduler
+#define TIMER_VECTOR    0xEF
+#define SPURIOUS_VECTOR 0xFF
+
+bool apic_init(void);
+void lapic_init_cpu(void);
+uint32_t lapic_id(void);
+void lapic_eoi(void);
+
+// Processor bring-up
+unsigned int apic_cpu_count(void);
+uint32_t apic_cpu_id(unsigned int i);
+void lapic_send_init(uint32_t apic_id);
+void lapic_send_startup(uint32_t apic_id, uint8_t page);
+void lapic_send_vector(uint32_t apic_id, uint8_t vector);
+
+// One-shot LAPIC timer on TIMER_VECTOR; expiries are ktime_get_ns() values
+bool lapic_timer_init(void);
+const char *lapic_timer_mode(void);
+void lapic_timer_arm(uint64_t expires);
+void lapic_timer_disarm(void);
+
+// ISA IRQs, translated through the MADT's source overrides
+void ioapic_mask(uint8_t irq);
+void ioapic_unmask(uint8_t irq);
+
+#endif
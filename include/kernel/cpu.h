@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CPU_H
+#define CPU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <kernel/percpu.h>
+
+struct cpu_features {
+    uint32_t max_leaf;
+    uint32_t max_ext_leaf;
+    bool sse2;
+    bool sse42;
+    bool xsave;
+    bool osxsave;
+    bool avx;
+    bool avx2;
+    bool erms;      // enhanced rep movsb/stosb
+    bool fsrm;      // fast short rep movsb
+    bool apic;      // on-chip local APIC
+    bool pat;       // page attribute table
+    bool pdpe1gb;   // 1 GiB pages
+    bool pge;       // global pages
+    bool nx;        // no-execute bit
+    bool pcid;      // process-context identifiers
+    bool invpcid;
+    bool tsc_invariant; // constant rate, not stopped in deep C-states
+    bool tsc_deadline;  // LAPIC timer TSC-deadline mode
+};
+
+#define MAX_CPUS 64
+
+extern struct cpu_features cpu_features;
+extern uint32_t cpu_tsc_khz;   // 0 when the TSC frequency is unknown
+
+void cpu_init(void);
+
+// Index into per-CPU arrays, 0 for the boot CPU
+static inline unsigned int cpu_id(void)
+{
+    return this_cpu_read(cpu_number);
+}
+
+static inline void cpuid(uint32_t leaf, uint32_t subleaf,
+                         uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d)
+{
+    asm volatile ("cpuid"
+                  : "=a" (*a), "=b" (*b), "=c" (*c), "=d" (*d)
+                  : "a" (leaf), "c" (subleaf));
+}
+
+static inline uint64_t xgetbv(uint32_t index)
+{
+    uint32_t lo, hi;
+    asm volatile ("xgetbv" : "=a" (lo), "=d" (hi) : "c" (index));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline uint64_t rdmsr(uint32_t msr)
+{
+    uint32_t lo, hi;
+    asm volatile ("rdmsr" : "=a" (lo), "=d" (hi) : "c" (msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value)
+{
+    asm volatile ("wrmsr" : : "c" (msr), "a" ((uint32_t)value), "d" ((uint32_t)(value >> 32)));
+}
+
+static inline uint64_t read_cr3(void)
+{
+    uint64_t v;
+    asm volatile ("mov %%cr3, %0" : "=r" (v));
+    return v;
+}
+
+static inline void write_cr3(uint64_t v)
+{
+    asm volatile ("mov %0, %%cr3" : : "r" (v) : "memory");
+}
+
+static inline uint64_t read_cr4(void)
+{
+    uint64_t v;
+    asm volatile ("mov %%cr4, %0" : "=r" (v));
+    return v;
+}
+
+static inline void write_cr4(uint64_t v)
+{
+    asm volatile ("mov %0, %%cr4" : : "r" (v) : "memory");
+}
+
+static inline void invlpg(uint64_t addr)
+{
+    asm volatile ("invlpg (%0)" : : "r" (addr) : "memory");
+}
+
+static inline void invpcid(uint64_t type, uint64_t pcid, uint64_t addr)
+{
+    struct { uint64_t pcid, addr; } desc = { pcid, addr };
+    asm volatile ("invpcid %0, %1" : : "m" (desc), "r" (type) : "memory");
+}
+
+// Sleep until the next interrupt; the sti shadow closes the race with hlt
+static inline void cpu_halt(void)
+{
+    asm volatile ("sti; hlt" : : : "memory");
+}
+
+static inline uint64_t rdtsc(void)
+{
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+#endif
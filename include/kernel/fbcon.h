@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FBCON_H
+#define FBCON_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Text console on the multiboot2 linear framebuffer. Cells use the VGA
+ * text layout (char | fore << 8 | back << 12) so screen.c can keep one
+ * shadow buffer for both outputs.
+ */
+bool fbcon_init(size_t *cols, size_t *rows);
+void fbcon_scroll(size_t lines);
+void fbcon_draw(size_t y, size_t x0, size_t x1, const uint16_t *cells);
+void fbcon_flush(void);
+void *fbcon_map_wc(void);
+void fbcon_set_mapping(void *mapping);
+size_t fbcon_refresh(void);
+
+#endif
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FPU_H
+#define FPU_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * The kernel is built with -mgeneral-regs-only, so x87, SSE and AVX
+ * registers are only touched between kernel_fpu_begin() and
+ * kernel_fpu_end(). In a thread with interrupts on, sections nest and
+ * may be preempted, and only then is the thread's vector state saved.
+ * An interrupt handler (or code with interrupts off) that lands inside
+ * a thread's section puts that state aside and back. Only a section
+ * inside another such handler's section is refused, so callers keep
+ * an integer fallback:
+ *
+ *     if (kernel_fpu_begin()) {
+ *         ... vector code ...
+ *         kernel_fpu_end();
+ *     } else {
+ *         ... integer code ...
+ *     }
+ *
+ * Nothing in the registers survives from one section to the next, and
+ * a section must not turn interrupts on or off.
+ */
+void fpu_init(void);
+size_t fpu_state_size(void);
+void fpu_save(void *area);
+void fpu_restore(const void *area);
+
+bool kernel_fpu_begin(void);
+void kernel_fpu_end(void);
+
+struct thread;
+void fpu_switch(struct thread *prev, struct thread *next);
+
+#endif
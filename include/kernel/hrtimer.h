@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HRTIMER_H
+#define HRTIMER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define HRTIMER_MAX 256 // pending timers per CPU
+
+struct hrtimer;
+typedef void (*hrtimer_fn_t)(struct hrtimer *timer);
+
+// Callbacks run in interrupt context on the CPU that started the timer
+struct hrtimer {
+    uint64_t expires;       // ktime_get_ns() value
+    hrtimer_fn_t fn;
+    unsigned int index;     // heap slot, HRTIMER_INACTIVE when not queued
+    unsigned int cpu;
+};
+
+#define HRTIMER_INACTIVE 0xFFFFFFFF
+
+void hrtimer_init(void);
+void hrtimer_init_cpu(void);
+void hrtimer_setup(struct hrtimer *timer, hrtimer_fn_t fn);
+bool hrtimer_start(struct hrtimer *timer, uint64_t expires);
+bool hrtimer_cancel(struct hrtimer *timer);
+
+static inline bool hrtimer_active(const struct hrtimer *timer)
+{
+    return timer->index != HRTIMER_INACTIVE;
+}
+
+#endif
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IDT_H
+#define IDT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define IDT_ENTRIES    256
+#define EXCEPTION_COUNT 32
+
+/*
+ * Register state pushed by the entry stubs in isr.s. Interrupt handlers
+ * are C functions that preserve the callee-saved registers themselves,
+ * so those are only saved (and valid here) for exceptions.
+ */
+struct int_frame {
+    uint64_t r15, r14, r13, r12, rbp, rbx;     // exceptions only
+    uint64_t r11, r10, r9, r8, rdi, rsi, rdx, rcx, rax;
+    uint64_t vector;
+    uint64_t error_code;
+    uint64_t rip, cs, rflags, rsp, ss;
+};
+
+typedef void (*int_handler_t)(struct int_frame *frame);
+
+void idt_init(void);
+void idt_load(void);
+void int_register(uint8_t vector, int_handler_t handler);
+void int_report(void);
+
+static inline void int_enable(void)
+{
+    asm volatile ("sti" : : : "memory");
+}
+
+static inline void int_disable(void)
+{
+    asm volatile ("cli" : : : "memory");
+}
+
+// Disable interrupts, returning the previous RFLAGS for int_restore()
+static inline uint64_t int_save(void)
+{
+    uint64_t flags;
+    asm volatile ("pushfq; pop %0; cli" : "=r" (flags) : : "memory");
+    return flags;
+}
+
+static inline void int_restore(uint64_t flags)
+{
+    if (flags & (1 << 9)) int_enable();
+}
+
+static inline bool int_enabled(void)
+{
+    uint64_t flags;
+    asm volatile ("pushfq; pop %0" : "=r" (flags));
+    return flags & (1 << 9);
+}
+
+#endif
@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IRQ_H
+#define IRQ_H
+
+#include <stdint.h>
+#include <kernel/idt.h>
+
+/*
+ * ISA device interrupts, delivered through the IOAPIC when there is one
+ * and the 8259 PIC otherwise. Handlers run with the EOI still pending.
+ */
+void irq_init(void);
+void irq_register(uint8_t irq, int_handler_t handler);
+void irq_mask(uint8_t irq);
+void irq_unmask(uint8_t irq);
+
+#endif
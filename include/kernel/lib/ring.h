@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ * 
+ * This file is part of Solum OS
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RING_H
+#define RING_H
+
+#include <stddef.h>
+
+/*
+ * Byte ring over a power-of-two buffer. head and tail count bytes ever
+ * pushed and popped, so they never wrap and head - tail is the fill
+ * level. One producer moves head and one consumer moves tail, which
+ * lets the two sides run without a lock; each index has a cache line of
+ * its own. Data moves as at most two memcpy() segments, split where the
+ * buffer wraps.
+ */
+struct ring {
+    char *buf;
+    size_t size;
+    size_t head __attribute__((aligned(64)));
+    size_t tail __attribute__((aligned(64)));
+};
+
+#define RING_INIT(array) { .buf = (array), .size = sizeof(array) }
+
+void ring_init(struct ring *r, void *buf, size_t size);
+
+static inline size_t ring_used(const struct ring *r)
+{
+    return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+}
+
+static inline size_t ring_space(const struct ring *r)
+{
+    return r->size - ring_used(r);
+}
+
+// Where byte pos lives, and how many bytes from there run to the end of buf
+static inline char *ring_ptr(const struct ring *r, size_t pos)
+{
+    return r->buf + (pos & (r->size - 1));
+}
+
+static inline size_t ring_span_at(const struct ring *r, size_t pos, size_t len)
+{
+    size_t span = r->size - (pos & (r->size - 1));
+    return span < len ? span : len;
+}
+
+// Copy to or from an arbitrary position, for producers that reserve first
+void ring_write_at(struct ring *r, size_t pos, const void *src, size_t len);
+void ring_read_at(const struct ring *r, size_t pos, void *dest, size_t len);
+
+// Producer side: push copies as much as fits and returns how much that was
+size_t ring_push(struct ring *r, const void *src, size_t len);
+size_t ring_write_span(const struct ring *r, char **span);
+void ring_produce(struct ring *r, size_t len);
+
+// Consumer side: peek copies like pop but leaves the bytes queued
+size_t ring_pop(struct ring *r, void *dest, size_t len);
+size_t ring_peek(const struct ring *r, void *dest, size_t len);
+size_t ring_read_span(const struct ring *r, const char **span);
+void ring_consume(struct ring *r, size_t len);
+
+#endif
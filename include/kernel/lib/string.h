@@ -44,5 +44,7 @@ char *k_int64_to_string(int64_t num, char *buffer, size_t buffer_size);
 char *k_num_to_hexstr(uint64_t number, bool need_0x, char *buffer, size_t buffer_size);
 char *k_strreverse(char *str);
 int k_atoi(const char *str);
+void k_string_init(void);
+const char *k_string_variant(void);
 
 #endif
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define LOG_BUF_SIZE (64 * 1024)
+#define LOG_TEXT_MAX 1024
+
+// One reader per consumer (console, dmesg, crash dumper...)
+struct log_reader {
+    uint64_t seq;   // next record to read
+    uint32_t idx;   // its offset in the log buffer
+    uint64_t lost;  // records overwritten before this reader got to them
+};
+
+struct log_entry {
+    uint64_t seq;
+    uint64_t tsc;
+    int level;
+    size_t len;
+};
+
+uint64_t log_store(int level, uint64_t tsc, const char *text, size_t len);
+void log_reader_init(struct log_reader *r, bool from_oldest);
+bool log_read(struct log_reader *r, struct log_entry *e, char *buf, size_t size);
+uint64_t log_first_seq(void);
+uint64_t log_next_seq(void);
+
+#endif
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PAGING_H
+#define PAGING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PAGE_SHIFT      12
+#define PAGE_SIZE       0x1000
+#define LARGE_PAGE_SIZE 0x200000
+#define HUGE_PAGE_SIZE  0x40000000ULL // 1 GiB
+
+#define BOOT_MAP_SIZE   0x100000000ULL // boot.s maps the first 4 GiB
+
+#define PTE_PRESENT  (1ULL << 0)
+#define PTE_WRITE    (1ULL << 1)
+#define PTE_USER     (1ULL << 2)
+#define PTE_PWT      (1ULL << 3)
+#define PTE_PCD      (1ULL << 4)
+#define PTE_HUGE     (1ULL << 7)
+#define PTE_PAT      (1ULL << 7)    // 4 KiB entries
+#define PTE_GLOBAL   (1ULL << 8)
+#define PTE_PAT_HUGE (1ULL << 12)   // 2 MiB / 1 GiB entries
+#define PTE_NX       (1ULL << 63)
+#define PTE_ADDR     0x000FFFFFFFFFF000ULL
+
+// All physical memory is visible at PAGE_OFFSET (PML4 slot 256)
+#define PAGE_OFFSET 0xFFFF800000000000ULL
+
+// The kernel image is linked at KERNEL_VMA + its load address (slot 511)
+#define KERNEL_VMA  0xFFFFFFFF80000000ULL
+
+static inline void *phys_to_virt(uint64_t phys)
+{
+    return (void *)(uintptr_t)(phys + PAGE_OFFSET);
+}
+
+static inline uint64_t virt_to_phys(const void *virt)
+{
+    return (uint64_t)(uintptr_t)virt - PAGE_OFFSET;
+}
+
+/*
+ * Memory types, numbered by their PAT index: bit 0 selects PWT and
+ * bit 1 PCD in a page table entry. pat_init() fills the PAT to match.
+ */
+enum page_cache {
+    PAGE_WB = 0,
+    PAGE_WC = 1,
+    PAGE_UC_MINUS = 2,
+    PAGE_UC = 3,
+};
+
+// PAT indexes 4-7 are never used, so the PAT bit itself stays clear
+static inline uint64_t pte_cache_bits(enum page_cache cache)
+{
+    uint64_t bits = 0;
+    if (cache & 1) bits |= PTE_PWT;
+    if (cache & 2) bits |= PTE_PCD;
+    return bits;
+}
+
+// Every page table is reached through the direct map
+static inline uint64_t *table_at(uint64_t entry)
+{
+    return phys_to_virt(entry & PTE_ADDR);
+}
+
+void pat_init(void);
+void paging_init(void);
+uint64_t *split_large_page(uint64_t *entry, uint64_t size);
+void *ioremap(uint64_t phys, size_t size, enum page_cache cache);
+
+#endif
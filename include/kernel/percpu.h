@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PERCPU_H
+#define PERCPU_H
+
+#include <stdint.h>
+
+/*
+ * Per-CPU variables live in the .percpu section, which is linked at
+ * address 0 and loaded as a template. Each CPU runs on its own copy
+ * with the GS base pointing at it, so a variable's link address is its
+ * offset from GS and this_cpu_read() is a single instruction.
+ */
+#define DEFINE_PER_CPU(type, name) __attribute__((section(".percpu"))) __typeof__(type) name
+#define DECLARE_PER_CPU(type, name) extern DEFINE_PER_CPU(type, name)
+
+DECLARE_PER_CPU(unsigned int, cpu_number);
+DECLARE_PER_CPU(uintptr_t, this_cpu_off);   // address of this CPU's copy
+
+extern uintptr_t percpu_offset[];           // address of each CPU's copy
+
+// Scalars only (1, 2, 4 or 8 bytes); %P emits the bare symbol as a displacement
+#define this_cpu_read(var) ({                                                           \
+    __typeof__(var) val__;                                                              \
+    switch (sizeof(var)) {                                                              \
+    case 1: asm volatile ("movb %%gs:%P1, %b0" : "=q" (val__) : "i" (&(var))); break;   \
+    case 2: asm volatile ("movw %%gs:%P1, %w0" : "=r" (val__) : "i" (&(var))); break;   \
+    case 4: asm volatile ("movl %%gs:%P1, %k0" : "=r" (val__) : "i" (&(var))); break;   \
+    default: asm volatile ("movq %%gs:%P1, %q0" : "=r" (val__) : "i" (&(var))); break;  \
+    }                                                                                   \
+    val__;                                                                              \
+})
+
+#define this_cpu_write(var, val) do {                                                                   \
+    __typeof__(var) val__ = (val);                                                                      \
+    switch (sizeof(var)) {                                                                              \
+    case 1: asm volatile ("movb %b0, %%gs:%P1" : : "q" (val__), "i" (&(var)) : "memory"); break;        \
+    case 2: asm volatile ("movw %w0, %%gs:%P1" : : "r" (val__), "i" (&(var)) : "memory"); break;        \
+    case 4: asm volatile ("movl %k0, %%gs:%P1" : : "r" (val__), "i" (&(var)) : "memory"); break;        \
+    default: asm volatile ("movq %q0, %%gs:%P1" : : "r" (val__), "i" (&(var)) : "memory"); break;       \
+    }                                                                                                   \
+} while (0)
+
+// One instruction, so neither an interrupt nor a migration can split it
+#define this_cpu_add(var, val) do {                                                                     \
+    __typeof__(var) val__ = (val);                                                                      \
+    switch (sizeof(var)) {                                                                              \
+    case 1: asm volatile ("addb %b0, %%gs:%P1" : : "q" (val__), "i" (&(var)) : "memory", "cc"); break;  \
+    case 2: asm volatile ("addw %w0, %%gs:%P1" : : "r" (val__), "i" (&(var)) : "memory", "cc"); break;  \
+    case 4: asm volatile ("addl %k0, %%gs:%P1" : : "r" (val__), "i" (&(var)) : "memory", "cc"); break;  \
+    default: asm volatile ("addq %q0, %%gs:%P1" : : "r" (val__), "i" (&(var)) : "memory", "cc"); break; \
+    }                                                                                                   \
+} while (0)
+
+#define this_cpu_inc(var) this_cpu_add(var, 1)
+#define this_cpu_dec(var) this_cpu_add(var, -1)
+
+// Ordinary pointers, for aggregates and for other CPUs' copies
+#define per_cpu_ptr(var, cpu) ((__typeof__(var) *)((uintptr_t)&(var) + percpu_offset[cpu]))
+#define this_cpu_ptr(var)     ((__typeof__(var) *)((uintptr_t)&(var) + this_cpu_read(this_cpu_off)))
+
+#endif
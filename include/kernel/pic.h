@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PIC_H
+#define PIC_H
+
+#include <stdint.h>
+#include <kernel/idt.h>
+
+#define PIC_IRQ_BASE 0x20   // IRQ 0-15 are remapped to vectors 0x20-0x2F
+
+void pic_init(void);
+void pic_disable(void);
+void pic_register(uint8_t irq, int_handler_t handler);
+void pic_mask(uint8_t irq);
+void pic_unmask(uint8_t irq);
+
+#endif
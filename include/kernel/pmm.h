@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PMM_H
+#define PMM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PMM_MAX_ORDER 11 // blocks of 1 page up to 4 MiB
+
+// Allocation flags
+#define PMM_DMA   (1 << 0) // below 16 MiB
+#define PMM_DMA32 (1 << 1) // below 4 GiB
+#define PMM_ZERO  (1 << 2) // clear the pages
+
+enum pmm_zone_type {
+    ZONE_DMA,
+    ZONE_DMA32,
+    ZONE_NORMAL,
+    ZONE_COUNT,
+};
+
+void pmm_init(void);
+void pmm_add_memory(uint64_t lo, uint64_t hi);
+
+/*
+ * Physical page allocator. Addresses are physical, 0 means failure
+ * (page 0 is never handed out). Use phys_to_virt() to access them.
+ */
+uint64_t pmm_alloc_pages(unsigned int order, unsigned int flags);
+void pmm_free_pages(uint64_t phys, unsigned int order);
+uint64_t pmm_alloc_page(unsigned int flags);
+void pmm_free_page(uint64_t phys);
+
+bool pmm_is_ram(uint64_t start, uint64_t end);
+uint64_t pmm_max_addr(void);
+uint64_t pmm_free_count(void);
+void pmm_report(void);
+
+#endif
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PREEMPT_H
+#define PREEMPT_H
+
+#include <stdbool.h>
+#include <kernel/percpu.h>
+
+/*
+ * A thread may be switched out whenever interrupts are on and its CPU's
+ * preempt_count is zero. Spinlocks raise the count, so a lock holder
+ * keeps its CPU until it lets go. need_resched asks for a switch at the
+ * next point where that is allowed.
+ */
+DECLARE_PER_CPU(unsigned int, preempt_count);
+DECLARE_PER_CPU(bool, need_resched);
+
+void preempt_schedule(void);
+
+static inline void preempt_disable(void)
+{
+    this_cpu_inc(preempt_count);
+}
+
+static inline void preempt_enable_no_resched(void)
+{
+    this_cpu_dec(preempt_count);
+}
+
+static inline void preempt_enable(void)
+{
+    this_cpu_dec(preempt_count);
+    if (this_cpu_read(need_resched) && !this_cpu_read(preempt_count)) preempt_schedule();
+}
+
+#endif
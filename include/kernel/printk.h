@@ -32,6 +32,18 @@
 #define KERN_INFO    "<6>"
 #define KERN_DEBUG   "<7>"
 
+void printk_init(void);
 int printk(const char *format, ...);
 
+/*
+ * Deferred printk: records the format pointer and packed arguments in a
+ * lock-free ring and returns; bprintk_flush() formats and outputs them,
+ * from the thread bprintk_init() starts or ahead of the next printk().
+ * The format string must stay valid until then (use literals). It wakes
+ * that thread, so not for code holding a run queue lock.
+ */
+int bprintk(const char *format, ...);
+void bprintk_flush(void);
+void bprintk_init(void);
+
 #endif
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Urgency levels, numbered like the KERN_* log levels: a PRIO_EMERG
+ * thread runs before anything else, PRIO_DEBUG only when nothing more
+ * urgent is ready. Threads at the same level share the CPU round robin.
+ */
+#define PRIO_EMERG   0
+#define PRIO_ALERT   1
+#define PRIO_CRIT    2
+#define PRIO_ERR     3
+#define PRIO_WARN    4
+#define PRIO_NOTICE  5
+#define PRIO_INFO    6
+#define PRIO_DEBUG   7
+#define PRIO_LEVELS  8
+#define PRIO_DEFAULT PRIO_NOTICE
+
+#define THREAD_PINNED (1 << 0)  // stays on the CPU that created it
+
+#define SCHED_SLICE_NS 10000000 // time slice between threads of equal urgency
+
+enum thread_state {
+    THREAD_RUNNING,
+    THREAD_READY,
+    THREAD_BLOCKED,
+    THREAD_DEAD,
+};
+
+typedef void (*thread_fn_t)(void *arg);
+
+struct thread {
+    uint64_t rsp;               // saved by switch_to(), must stay first
+    void *stack;                // NULL for the boot contexts
+    enum thread_state state;
+    unsigned int prio;
+    unsigned int cpu;           // run queue it is on or last ran from
+    unsigned int flags;
+    struct thread *next;        // run queue link
+    bool wake_pending;          // woken before it blocked
+    unsigned int fpu_depth;     // kernel_fpu_begin() nesting
+    void *fpu;                  // vector state while preempted in a section, 64-byte aligned
+    void *fpu_alloc;
+    char name[16];
+};
+
+void sched_init(void);
+void sched_init_cpu(void);
+__attribute__((noreturn)) void sched_idle(void);
+void sched_preempt_irq(void);
+void sched_report(void);
+
+struct thread *thread_create(const char *name, thread_fn_t fn, void *arg, unsigned int prio, unsigned int flags);
+struct thread *thread_current(void);
+void thread_yield(void);
+void thread_block(void);
+void thread_wake(struct thread *t);
+__attribute__((noreturn)) void thread_exit(void);
+
+void schedule(void);
+
+#endif
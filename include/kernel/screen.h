@@ -21,7 +21,9 @@
 #define SCREEN_H
 
 #include <stdint.h>
+#include <stddef.h>
 #include <stdarg.h>
+#include <stdbool.h>
 
 typedef enum {
     BLACK = 0,
@@ -42,7 +44,18 @@ typedef enum {
     WHITE = 15
 } vga_color_t;
 
+// Text in one colour; a batch of runs reaches the display in one update
+struct scr_run {
+    const char *text;
+    size_t len;
+    vga_color_t fore;
+    vga_color_t back;
+};
+
 void scr_init(void);
 void scr_write(const char *buf, size_t len, vga_color_t fore, vga_color_t back);
+void scr_write_runs(const struct scr_run *runs, size_t n);
+bool scr_remap(void);
+size_t scr_refresh(void);
 
 #endif
\ No newline at end of file
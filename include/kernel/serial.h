@@ -23,8 +23,11 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <kernel/screen.h>
 
 void srl_init(void);
+void srl_irq_init(void);
 void srl_write(const char *buf, size_t len);
+void srl_write_runs(const struct scr_run *runs, size_t n);
 
 #endif
\ No newline at end of file
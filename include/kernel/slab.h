@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define KMALLOC_MAX_SIZE 8192
+
+#define SLAB_NO_MAGAZINE (1 << 0) // every alloc/free goes to the slab layer
+
+struct kmem_cache;
+
+void slab_init(void);
+
+/*
+ * Object caches. The constructor runs once per object when its slab is
+ * created, not on every allocation: objects must be returned to
+ * kmem_cache_free() in their constructed state.
+ */
+struct kmem_cache *kmem_cache_create(const char *name, size_t size, size_t align,
+                                     unsigned int flags, void (*ctor)(void *));
+void *kmem_cache_alloc(struct kmem_cache *cache);
+void kmem_cache_free(struct kmem_cache *cache, void *obj);
+
+// General purpose allocations up to KMALLOC_MAX_SIZE bytes
+void *kmalloc(size_t size);
+void *kzalloc(size_t size);
+void kfree(void *obj);
+
+void kmem_report(void);
+
+#endif
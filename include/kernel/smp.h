@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SMP_H
+#define SMP_H
+
+#include <stdint.h>
+#include <kernel/percpu.h>
+
+extern unsigned int nr_cpus;    // online, numbered 0 (the boot CPU) to nr_cpus - 1
+
+DECLARE_PER_CPU(uint32_t, cpu_apic_id);  // IPI destination, set when a second CPU exists
+
+void smp_init(void);
+
+#endif
@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <kernel/idt.h>
+#include <kernel/preempt.h>
+
+#ifdef CONFIG_LOCKSTAT
+/*
+ * Statistics shared by every lock initialised at the same place, kept
+ * when the kernel is built with LOCKSTAT=1. Times are in TSC cycles.
+ */
+struct lock_class {
+    const char *name;
+    uint64_t acquired;
+    uint64_t contended;
+    uint64_t wait_cycles;       // total spent queueing
+    uint64_t max_hold_cycles;
+    struct lock_class *next;
+    bool registered;
+};
+#endif
+
+/*
+ * Queued spinlock. Taking a free lock is one cmpxchg. Waiters queue
+ * MCS-style on per-CPU nodes and each spins on its own node, so only
+ * the head of the queue watches the lock word and a release touches
+ * one waiter's cache line, not everybody's. FIFO, so also fair.
+ */
+typedef struct {
+    union {
+        uint32_t val;
+        struct {
+            uint8_t locked;
+            uint8_t reserved;
+            uint16_t tail;      // last waiter's node, 0 when nobody queues
+        };
+    };
+#ifdef CONFIG_LOCKSTAT
+    struct lock_class *class;
+    uint64_t acquired_at;
+#endif
+} spinlock_t;
+
+#ifdef CONFIG_LOCKSTAT
+#define SPINLOCK_INIT(lockname) { .val = 0, .class = &(struct lock_class){ .name = #lockname } }
+#define spin_lock_init(lock) do {                                   \
+    static struct lock_class class__ = { .name = #lock };          \
+    *(lock) = (spinlock_t){ .val = 0, .class = &class__ };         \
+} while (0)
+#else
+#define SPINLOCK_INIT(lockname) { .val = 0 }
+#define spin_lock_init(lock) (*(lock) = (spinlock_t){ .val = 0 })
+#endif
+
+// File scope only; the class takes the variable's name
+#define DEFINE_SPINLOCK(lockname) spinlock_t lockname = SPINLOCK_INIT(lockname)
+
+void spin_lock_slowpath(spinlock_t *lock);
+
+#ifdef CONFIG_LOCKSTAT
+void lockstat_acquired(spinlock_t *lock);
+void lockstat_released(spinlock_t *lock);
+#else
+static inline void lockstat_acquired(spinlock_t *lock) { (void)lock; }
+static inline void lockstat_released(spinlock_t *lock) { (void)lock; }
+#endif
+void lockstat_report(void);
+
+// Holding a spinlock keeps preemption off, see preempt.h
+static inline bool spin_trylock(spinlock_t *lock)
+{
+    uint32_t unlocked = 0;
+    preempt_disable();
+    if (!__atomic_compare_exchange_n(&lock->val, &unlocked, 1, false,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        preempt_enable();
+        return false;
+    }
+    lockstat_acquired(lock);
+    return true;
+}
+
+static inline void spin_lock(spinlock_t *lock)
+{
+    uint32_t unlocked = 0;
+    preempt_disable();
+    if (!__atomic_compare_exchange_n(&lock->val, &unlocked, 1, false,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        spin_lock_slowpath(lock);
+    }
+    lockstat_acquired(lock);
+}
+
+static inline void spin_release(spinlock_t *lock)
+{
+    lockstat_released(lock);
+    __atomic_store_n(&lock->locked, 0, __ATOMIC_RELEASE);
+}
+
+static inline void spin_unlock(spinlock_t *lock)
+{
+    spin_release(lock);
+    preempt_enable();
+}
+
+// For locks also taken by interrupt handlers; returns the flags to restore
+static inline uint64_t spin_lock_irqsave(spinlock_t *lock)
+{
+    uint64_t flags = int_save();
+    spin_lock(lock);
+    return flags;
+}
+
+// Interrupts come back on before a pending reschedule is honoured
+static inline void spin_unlock_irqrestore(spinlock_t *lock, uint64_t flags)
+{
+    spin_release(lock);
+    int_restore(flags);
+    preempt_enable();
+}
+
+/*
+ * Reader-writer lock. Readers share the lock; a waiting writer holds
+ * off new readers, so writers are not starved. Contended acquisitions
+ * of either kind queue in FIFO order on the internal spinlock. An
+ * interrupt handler that takes the lock needs the irqsave variants on
+ * every side.
+ */
+typedef struct {
+    uint32_t cnts;              // readers << RW_READER_SHIFT | RW_WAITING | RW_LOCKED
+    spinlock_t wait;
+} rwlock_t;
+
+#define RW_LOCKED       0xFFU   // a writer holds the lock
+#define RW_WAITING      0x100U  // a writer is queued
+#define RW_WRITER_MASK  0x1FFU
+#define RW_READER       0x200U
+
+#define RWLOCK_INIT(lockname) { .cnts = 0, .wait = SPINLOCK_INIT(lockname) }
+#define DEFINE_RWLOCK(lockname) rwlock_t lockname = RWLOCK_INIT(lockname)
+#define rwlock_init(rw) do { (rw)->cnts = 0; spin_lock_init(&(rw)->wait); } while (0)
+
+void read_lock_slowpath(rwlock_t *rw);
+void write_lock_slowpath(rwlock_t *rw);
+
+static inline void read_lock(rwlock_t *rw)
+{
+    preempt_disable();
+    uint32_t cnts = __atomic_add_fetch(&rw->cnts, RW_READER, __ATOMIC_ACQUIRE);
+    if (cnts & RW_WRITER_MASK) read_lock_slowpath(rw);
+}
+
+static inline void read_unlock(rwlock_t *rw)
+{
+    __atomic_sub_fetch(&rw->cnts, RW_READER, __ATOMIC_RELEASE);
+    preempt_enable();
+}
+
+static inline void write_lock(rwlock_t *rw)
+{
+    uint32_t unlocked = 0;
+    preempt_disable();
+    if (!__atomic_compare_exchange_n(&rw->cnts, &unlocked, RW_LOCKED, false,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        write_lock_slowpath(rw);
+    }
+}
+
+static inline void write_unlock(rwlock_t *rw)
+{
+    __atomic_store_n((uint8_t *)&rw->cnts, 0, __ATOMIC_RELEASE);
+    preempt_enable();
+}
+
+static inline uint64_t read_lock_irqsave(rwlock_t *rw)
+{
+    uint64_t flags = int_save();
+    read_lock(rw);
+    return flags;
+}
+
+static inline void read_unlock_irqrestore(rwlock_t *rw, uint64_t flags)
+{
+    preempt_disable();
+    read_unlock(rw);
+    int_restore(flags);
+    preempt_enable();
+}
+
+static inline uint64_t write_lock_irqsave(rwlock_t *rw)
+{
+    uint64_t flags = int_save();
+    write_lock(rw);
+    return flags;
+}
+
+static inline void write_unlock_irqrestore(rwlock_t *rw, uint64_t flags)
+{
+    preempt_disable();
+    write_unlock(rw);
+    int_restore(flags);
+    preempt_enable();
+}
+
+/*
+ * Sequence lock, for small data read far more often than written.
+ * Readers take no lock at all; they retry when a writer ran meanwhile:
+ *
+ *     do {
+ *         seq = read_seqbegin(&sl);
+ *         copy = data;
+ *     } while (read_seqretry(&sl, seq));
+ *
+ * Readers must not follow pointers that a writer may free.
+ */
+typedef struct {
+    uint32_t sequence;          // odd while a writer is inside
+    spinlock_t lock;
+} seqlock_t;
+
+#define SEQLOCK_INIT(lockname) { .sequence = 0, .lock = SPINLOCK_INIT(lockname) }
+#define DEFINE_SEQLOCK(lockname) seqlock_t lockname = SEQLOCK_INIT(lockname)
+#define seqlock_init(sl) do { (sl)->sequence = 0; spin_lock_init(&(sl)->lock); } while (0)
+
+static inline uint32_t read_seqbegin(const seqlock_t *sl)
+{
+    uint32_t seq;
+    while ((seq = __atomic_load_n(&sl->sequence, __ATOMIC_ACQUIRE)) & 1) {
+        asm volatile ("pause");
+    }
+    return seq;
+}
+
+static inline bool read_seqretry(const seqlock_t *sl, uint32_t seq)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&sl->sequence, __ATOMIC_RELAXED) != seq;
+}
+
+static inline void write_seqlock(seqlock_t *sl)
+{
+    spin_lock(&sl->lock);
+    __atomic_store_n(&sl->sequence, sl->sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void write_sequnlock(seqlock_t *sl)
+{
+    __atomic_store_n(&sl->sequence, sl->sequence + 1, __ATOMIC_RELEASE);
+    spin_unlock(&sl->lock);
+}
+
+static inline uint64_t write_seqlock_irqsave(seqlock_t *sl)
+{
+    uint64_t flags = int_save();
+    write_seqlock(sl);
+    return flags;
+}
+
+static inline void write_sequnlock_irqrestore(seqlock_t *sl, uint64_t flags)
+{
+    preempt_disable();
+    write_sequnlock(sl);
+    int_restore(flags);
+    preempt_enable();
+}
+
+#endif
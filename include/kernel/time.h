@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TIME_H
+#define TIME_H
+
+#include <stdint.h>
+#include <kernel/cpu.h>
+
+#define NSEC_PER_SEC  1000000000ULL
+#define NSEC_PER_USEC 1000ULL
+
+#define TSC_SHIFT 32
+
+// Time zero is the TSC value when tsc_early_init() ran
+struct tsc_clock {
+    uint64_t base;
+    uint64_t mult;      // nanoseconds per cycle << TSC_SHIFT, 0 until the rate is known
+    uint64_t cyc_mult;  // cycles per nanosecond << TSC_SHIFT
+};
+
+extern struct tsc_clock tsc_clock;
+
+void tsc_early_init(void);
+void tsc_init(void);
+uint64_t cycles_to_ns(uint64_t cycles);
+
+// A multiply and a shift, no division
+static inline uint64_t tsc_to_ns(uint64_t tsc)
+{
+    if (tsc < tsc_clock.base) return 0;
+    return (uint64_t)(((unsigned __int128)(tsc - tsc_clock.base) * tsc_clock.mult) >> TSC_SHIFT);
+}
+
+// The TSC value at which ktime_get_ns() reaches ns
+static inline uint64_t ns_to_tsc(uint64_t ns)
+{
+    return tsc_clock.base + (uint64_t)(((unsigned __int128)ns * tsc_clock.cyc_mult) >> TSC_SHIFT);
+}
+
+static inline uint64_t ktime_get_ns(void)
+{
+    return tsc_to_ns(rdtsc());
+}
+
+// Busy-wait; needs the calibrated TSC
+static inline void udelay(uint64_t us)
+{
+    uint64_t end = ktime_get_ns() + us * NSEC_PER_USEC;
+    while (ktime_get_ns() < end) {
+        asm volatile ("pause");
+    }
+}
+
+#endif
@@ -25,6 +25,7 @@
 
 void tty_init(void);
 size_t tty_write(int fd, const char *buf, size_t len, vga_color_t fore, vga_color_t back);
+size_t tty_queue(const char *buf, size_t len, vga_color_t fore, vga_color_t back);
 size_t tty_read(char *dest, size_t len);
 void tty_flush(void);
 
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VMM_H
+#define VMM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <kernel/paging.h>
+#include <kernel/spinlock.h>
+
+// Protection flags for vmm_map() and vmm_protect(); readable is implied
+#define VM_WRITE    (1 << 0)
+#define VM_EXEC     (1 << 1)
+#define VM_USER     (1 << 2)
+#define VM_CACHE(c) ((unsigned int)(c) << 4) // enum page_cache, WB by default
+
+/*
+ * Up to this many entries are invalidated one by one with invlpg; a
+ * bigger batch flushes the whole address space instead (the ceiling
+ * Linux uses, where a full refill starts to win).
+ */
+#define MMU_GATHER_MAX 33
+
+struct address_space {
+    uint64_t *pml4;
+    uint16_t pcid;
+    uint64_t stale; // CPUs whose TLB may hold old entries for pcid
+    spinlock_t lock;
+};
+
+/*
+ * Pending TLB invalidations for one address space, which stays locked
+ * from tlb_gather_init() to tlb_gather_finish(). Page tables emptied by
+ * an unmap are only freed once the flush has happened, since the CPU
+ * may still walk them until then.
+ */
+struct mmu_gather {
+    struct address_space *as;
+    uint64_t addr[MMU_GATHER_MAX];
+    unsigned int nr;
+    bool flush_all;
+    bool freed_tables;
+    uint64_t free_list;     // physical address of the first table to free
+    uint64_t irq_flags;
+};
+
+extern struct address_space kernel_space;
+
+void vmm_init(void);
+void vmm_init_cpu(void);
+struct address_space *vmm_create(void);
+void vmm_destroy(struct address_space *as);
+void vmm_switch(struct address_space *as);
+
+// Ranges must be page aligned; the largest pages the alignment allows are used
+bool vmm_map(struct address_space *as, uint64_t virt, uint64_t phys, size_t size, unsigned int prot);
+bool vmm_unmap(struct address_space *as, uint64_t virt, size_t size);
+bool vmm_protect(struct address_space *as, uint64_t virt, size_t size, unsigned int prot);
+bool vmm_translate(struct address_space *as, uint64_t virt, uint64_t *phys);
+
+// Batch several unmaps of one address space into a single flush
+void tlb_gather_init(struct mmu_gather *tlb, struct address_space *as);
+bool tlb_gather_unmap(struct mmu_gather *tlb, uint64_t virt, size_t size);
+void tlb_gather_finish(struct mmu_gather *tlb);
+
+void flush_tlb_all(void);
+void flush_tlb_all_cpus(bool write_back);
+
+#endif
@@ -22,7 +22,14 @@
 
 #include <stdarg.h>
 #include <stddef.h>
+#include <stdint.h>
 
 int vsnprintf(char *out, size_t out_sz, const char *fmt, va_list args);
+int snprintf(char *out, size_t out_sz, const char *fmt, ...);
+
+// Pack the arguments of fmt into 64-bit words, returns the words used
+size_t vbin_printf(uint64_t *bin, size_t words, const char *fmt, va_list args);
+// Format fmt with arguments previously packed by vbin_printf()
+int bstr_printf(char *out, size_t out_sz, const char *fmt, const uint64_t *bin, size_t words);
 
 #endif
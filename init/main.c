@@ -18,16 +18,277 @@
  */
 
 #include <stddef.h>
+#include <stdint.h>
 #include <boot/info.h>
+#include <kernel/acpi.h>
+#include <kernel/cpu.h>
+#include <kernel/fpu.h>
+#include <kernel/gdt.h>
+#include <kernel/hrtimer.h>
+#include <kernel/idt.h>
+#include <kernel/irq.h>
+#include <kernel/paging.h>
+#include <kernel/pmm.h>
 #include <kernel/printk.h>
+#include <kernel/sched.h>
+#include <kernel/screen.h>
+#include <kernel/serial.h>
+#include <kernel/slab.h>
+#include <kernel/smp.h>
+#include <kernel/spinlock.h>
+#include <kernel/time.h>
 #include <kernel/tty.h>
+#include <kernel/vmm.h>
+#include <kernel/lib/string.h>
+
+#define STRING_BENCH_SIZE   (64 * 1024)
+#define STRING_BENCH_ROUNDS 64
+#define BLIT_BENCH_ROUNDS   8
+#define VMM_BENCH_BASE      0xFFFFC90000000000ULL // unused kernel-half slot
+#define VMM_BENCH_SIZE      (64ULL << 20)
+#define TIMER_BENCH_COUNT   16
+#define TIMER_BENCH_STEP    (100 * NSEC_PER_USEC)
+
+static uint8_t string_bench_buf[2][STRING_BENCH_SIZE] __attribute__((aligned(64)));
+
+// Report the selected string variant and a rough memcpy bandwidth
+static void string_report(void)
+{
+    k_memcpy(string_bench_buf[0], string_bench_buf[1], STRING_BENCH_SIZE);
+
+    uint64_t start = rdtsc();
+    for (int i = 0; i < STRING_BENCH_ROUNDS; i++) {
+        k_memcpy(string_bench_buf[i & 1], string_bench_buf[(i + 1) & 1], STRING_BENCH_SIZE);
+    }
+    uint64_t cycles = rdtsc() - start;
+    uint64_t bytes = (uint64_t)STRING_BENCH_SIZE * STRING_BENCH_ROUNDS;
+    if (!cycles) cycles = 1;
+
+    if (cpu_tsc_khz) {
+        uint64_t mbps = bytes * cpu_tsc_khz / cycles / 1000;
+        printk("string: %s, memcpy %lu.%lu GB/s\n", k_string_variant(), mbps / 1000, (mbps % 1000) / 100);
+    } else {
+        printk("string: %s, memcpy %lu bytes/kcycle\n", k_string_variant(), bytes * 1000 / cycles);
+    }
+}
+
+// Time full-screen framebuffer copies under the current mapping
+static void blit_report(const char *mapping)
+{
+    size_t bytes = scr_refresh();
+    if (!bytes) return;
+
+    uint64_t start = rdtsc();
+    for (int i = 0; i < BLIT_BENCH_ROUNDS; i++) {
+        scr_refresh();
+    }
+    uint64_t cycles = rdtsc() - start;
+    bytes *= BLIT_BENCH_ROUNDS;
+    if (!cycles) cycles = 1;
+
+    if (cpu_tsc_khz) {
+        printk("fbcon: %s blit %lu MB/s\n", mapping, bytes * cpu_tsc_khz / cycles / 1000);
+    } else {
+        printk("fbcon: %s blit %lu bytes/kcycle\n", mapping, bytes * 1000 / cycles);
+    }
+}
+
+/*
+ * Time map, protect and unmap of a large region in 4 KiB pages, then
+ * unmap it page by page (an invlpg each) against one batched unmap, and
+ * map and unmap 1 GiB in large pages.
+ */
+static void vmm_report(void)
+{
+    uint64_t pages = VMM_BENCH_SIZE >> PAGE_SHIFT;
+    uint64_t t[7];
+
+    // Physical addresses one page off the virtual alignment rule out large pages
+    t[0] = rdtsc();
+    if (!vmm_map(&kernel_space, VMM_BENCH_BASE, PAGE_SIZE, VMM_BENCH_SIZE, VM_WRITE)) {
+        printk(KERN_ERR "vmm: benchmark mapping failed\n");
+        return;
+    }
+    t[1] = rdtsc();
+    vmm_protect(&kernel_space, VMM_BENCH_BASE, VMM_BENCH_SIZE, 0);
+    t[2] = rdtsc();
+    vmm_unmap(&kernel_space, VMM_BENCH_BASE, VMM_BENCH_SIZE);
+    t[3] = rdtsc();
+
+    vmm_map(&kernel_space, VMM_BENCH_BASE, PAGE_SIZE, VMM_BENCH_SIZE, VM_WRITE);
+    t[4] = rdtsc();
+    for (uint64_t off = 0; off < VMM_BENCH_SIZE; off += PAGE_SIZE) {
+        vmm_unmap(&kernel_space, VMM_BENCH_BASE + off, PAGE_SIZE);
+    }
+    t[5] = rdtsc();
+
+    vmm_map(&kernel_space, VMM_BENCH_BASE, 0, HUGE_PAGE_SIZE, VM_WRITE);
+    vmm_unmap(&kernel_space, VMM_BENCH_BASE, HUGE_PAGE_SIZE);
+    t[6] = rdtsc();
+
+    printk("vmm: %lu MiB in 4 KiB pages, cycles/page: map %lu, protect %lu, unmap %lu, unmap singly %lu\n",
+           VMM_BENCH_SIZE >> 20, (t[1] - t[0]) / pages, (t[2] - t[1]) / pages,
+           (t[3] - t[2]) / pages, (t[5] - t[4]) / pages);
+    printk("vmm: 1 GiB in %s pages, map+unmap %lu cycles\n",
+           cpu_features.pdpe1gb ? "1 GiB" : "2 MiB", t[6] - t[5]);
+}
+
+static struct hrtimer bench_timers[TIMER_BENCH_COUNT];
+static uint64_t bench_late[TIMER_BENCH_COUNT];
+static volatile unsigned int bench_fired;
+
+static void bench_timer_fn(struct hrtimer *timer)
+{
+    bench_late[timer - bench_timers] = ktime_get_ns() - timer->expires;
+    bench_fired++;
+}
+
+// Start one-shot timers 100 us apart, in reverse order, and sleep until all have fired
+static void timer_report(void)
+{
+    uint64_t now = ktime_get_ns();
+
+    bench_fired = 0;
+    for (int i = TIMER_BENCH_COUNT - 1; i >= 0; i--) {
+        hrtimer_setup(&bench_timers[i], bench_timer_fn);
+        if (!hrtimer_start(&bench_timers[i], now + (uint64_t)(i + 1) * TIMER_BENCH_STEP)) return;
+    }
+    while (bench_fired < TIMER_BENCH_COUNT) {
+        cpu_halt();
+    }
+
+    uint64_t sum = 0, max = 0;
+    for (int i = 0; i < TIMER_BENCH_COUNT; i++) {
+        sum += bench_late[i];
+        if (bench_late[i] > max) max = bench_late[i];
+    }
+    printk("hrtimer: %u timers fired, late by %lu ns on average, %lu ns at most\n",
+           TIMER_BENCH_COUNT, sum / TIMER_BENCH_COUNT, max);
+}
+
+#define SCHED_BENCH_SWITCHES 10000
+#define SCHED_BENCH_WAKEUPS  1000
+
+static struct thread *bench_main, *bench_sleeper;
+static unsigned int bench_yielders;
+static uint64_t switch_start, switch_end;
+static uint64_t wake_stamp, wake_sum, wake_max;
+
+// Two threads hand the CPU back and forth while main sleeps
+static void bench_yield_fn(void *arg)
+{
+    (void)arg;
+    if (!switch_start) switch_start = rdtsc();
+    for (int i = 0; i < SCHED_BENCH_SWITCHES / 2; i++) {
+        thread_yield();
+    }
+    switch_end = rdtsc();
+    if (__atomic_add_fetch(&bench_yielders, 1, __ATOMIC_ACQ_REL) == 2) thread_wake(bench_main);
+}
+
+// More urgent than the waker, so each wakeup switches straight to it
+static void bench_sleeper_fn(void *arg)
+{
+    (void)arg;
+    for (int i = 0; i < SCHED_BENCH_WAKEUPS; i++) {
+        thread_block();
+        uint64_t cycles = rdtsc() - wake_stamp;
+        wake_sum += cycles;
+        if (cycles > wake_max) wake_max = cycles;
+    }
+}
+
+static void bench_waker_fn(void *arg)
+{
+    (void)arg;
+    for (int i = 0; i < SCHED_BENCH_WAKEUPS; i++) {
+        while (__atomic_load_n(&bench_sleeper->state, __ATOMIC_ACQUIRE) != THREAD_BLOCKED) {
+            thread_yield();
+        }
+        wake_stamp = rdtsc();
+        thread_wake(bench_sleeper);
+    }
+    thread_wake(bench_main);
+}
+
+// Context switch and wakeup-to-run latency, all on the boot CPU
+static void sched_bench(void)
+{
+    bench_main = thread_current();
+    if (!bench_main) return;
+
+    if (!thread_create("yield0", bench_yield_fn, NULL, PRIO_INFO, THREAD_PINNED) ||
+        !thread_create("yield1", bench_yield_fn, NULL, PRIO_INFO, THREAD_PINNED)) {
+        printk(KERN_ERR "sched: benchmark threads failed\n");
+        return;
+    }
+    while (__atomic_load_n(&bench_yielders, __ATOMIC_ACQUIRE) < 2) {
+        thread_block();
+    }
+
+    bench_sleeper = thread_create("sleeper", bench_sleeper_fn, NULL, PRIO_WARN, THREAD_PINNED);
+    if (!bench_sleeper || !thread_create("waker", bench_waker_fn, NULL, PRIO_INFO, THREAD_PINNED)) {
+        printk(KERN_ERR "sched: benchmark threads failed\n");
+        return;
+    }
+    thread_block();
+
+    uint64_t per_switch = (switch_end - switch_start) / SCHED_BENCH_SWITCHES;
+    uint64_t wake_avg = wake_sum / SCHED_BENCH_WAKEUPS;
+    printk("sched: context switch %lu cycles (%lu ns), wakeup to run %lu cycles (%lu ns) on average, "
+           "%lu cycles (%lu ns) at most\n",
+           per_switch, cycles_to_ns(per_switch),
+           wake_avg, cycles_to_ns(wake_avg), wake_max, cycles_to_ns(wake_max));
+}
 
 void main() 
 {
     parse_mb_info();
+    printk_init();
+    cpu_init();
+    fpu_init();
+    tsc_early_init();
+    pat_init();
+    k_string_init();
     tty_init();
+    pmm_init();
+    paging_init();
+    vmm_init();
+    slab_init();
+    acpi_init();
+    tsc_init();
+    gdt_init();
+    idt_init();
+    irq_init();
+    hrtimer_init();
+    sched_init();
+    bprintk_init();
+    smp_init();
+    srl_irq_init();
+    int_enable();
 
     printk("Welcome to Solum OS!\n");
     printk("Version (a0.01)\n");
     printk("By Roy - 2025\n");
+
+    string_report();
+    pmm_report();
+    kmem_report();
+    vmm_report();
+    timer_report();
+    sched_bench();
+
+    blit_report("boot mapping");
+    if (scr_remap()) {
+        blit_report("write-combining");
+    }
+    int_report();
+    lockstat_report();
+    sched_report();
+
+    // Leave the boot CPU to its idle thread
+    if (thread_current()) thread_exit();
+    for (;;) {
+        cpu_halt();
+    }
 }
\ No newline at end of file
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <boot/info.h>
+#include <kernel/acpi.h>
+#include <kernel/paging.h>
+#include <kernel/printk.h>
+#include <kernel/lib/string.h>
+
+#define BIOS_EBDA_PTR   0x40E
+#define BIOS_ROM_START  0xE0000
+#define BIOS_ROM_END    0x100000
+
+struct acpi_rsdp {
+    char signature[8];
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_addr;
+    // revision 2 and later
+    uint32_t length;
+    uint64_t xsdt_addr;
+    uint8_t ext_checksum;
+    uint8_t reserved[3];
+} __attribute__((packed));
+
+#define RSDP_V1_SIZE 20
+
+static const struct acpi_sdt_header *root;
+static size_t root_entry_size;  // 4 for the RSDT, 8 for the XSDT
+
+static bool checksum_ok(const void *p, size_t len)
+{
+    const uint8_t *b = p;
+    uint8_t sum = 0;
+    for (size_t i = 0; i < len; i++) sum += b[i];
+    return sum == 0;
+}
+
+static const struct acpi_rsdp *rsdp_scan(uint64_t start, uint64_t end)
+{
+    for (uint64_t addr = start; addr + RSDP_V1_SIZE <= end; addr += 16) {
+        const struct acpi_rsdp *rsdp = phys_to_virt(addr);
+        if (!k_memcmp(rsdp->signature, "RSD PTR ", 8) && checksum_ok(rsdp, RSDP_V1_SIZE)) return rsdp;
+    }
+    return NULL;
+}
+
+// The boot loader's copy first, then the first KiB of the EBDA and the BIOS ROM
+static const struct acpi_rsdp *rsdp_find(void)
+{
+    if (mb_acpi_rsdp) return mb_acpi_rsdp;
+
+    uint64_t ebda = (uint64_t)*(const uint16_t *)phys_to_virt(BIOS_EBDA_PTR) << 4;
+    const struct acpi_rsdp *rsdp = NULL;
+    if (ebda) rsdp = rsdp_scan(ebda, ebda + 1024);
+    if (!rsdp) rsdp = rsdp_scan(BIOS_ROM_START, BIOS_ROM_END);
+    return rsdp;
+}
+
+// Tables live in RAM or firmware ranges below 4 GiB, all in the direct map
+static const struct acpi_sdt_header *table_at_phys(uint64_t phys)
+{
+    if (!phys) return NULL;
+    const struct acpi_sdt_header *h = phys_to_virt(phys);
+    return checksum_ok(h, h->length) ? h : NULL;
+}
+
+static uint64_t root_entry(size_t i)
+{
+    const uint8_t *p = (const uint8_t *)(root + 1) + i * root_entry_size;
+    if (root_entry_size == 8) {
+        uint64_t v;
+        k_memcpy(&v, p, 8); // XSDT entries are only 4-byte aligned
+        return v;
+    }
+    return *(const uint32_t *)p;
+}
+
+void acpi_init(void)
+{
+    const struct acpi_rsdp *rsdp = rsdp_find();
+    if (!rsdp) {
+        printk(KERN_WARN "acpi: no RSDP found\n");
+        return;
+    }
+
+    if (rsdp->revision >= 2 && rsdp->xsdt_addr && checksum_ok(rsdp, rsdp->length)) {
+        root = table_at_phys(rsdp->xsdt_addr);
+        root_entry_size = 8;
+    }
+    if (!root) {
+        root = table_at_phys(rsdp->rsdt_addr);
+        root_entry_size = 4;
+    }
+    if (!root) {
+        printk(KERN_ERR "acpi: bad root table\n");
+        return;
+    }
+
+    size_t count = (root->length - sizeof(*root)) / root_entry_size;
+    printk("acpi: %s with %lu tables\n", root_entry_size == 8 ? "XSDT" : "RSDT", count);
+}
+
+// Returns the first table with a valid checksum and this signature
+const struct acpi_sdt_header *acpi_find_table(const char *signature)
+{
+    if (!root) return NULL;
+
+    size_t count = (root->length - sizeof(*root)) / root_entry_size;
+    for (size_t i = 0; i < count; i++) {
+        const struct acpi_sdt_header *h = phys_to_virt(root_entry(i));
+        if (k_memcmp(h->signature, signature, 4)) continue;
+        if (checksum_ok(h, h->length)) return h;
+    }
+    return NULL;
+}
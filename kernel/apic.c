@@ -0,0 +1,377 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <kernel/acpi.h>
+#include <kernel/apic.h>
+#include <kernel/cpu.h>
+#include <kernel/idt.h>
+#include <kernel/paging.h>
+#include <kernel/printk.h>
+#include <kernel/spinlock.h>
+#include <kernel/time.h>
+
+#define MSR_APIC_BASE     0x1B
+#define APIC_BASE_ENABLE  (1 << 11)
+#define APIC_BASE_ADDR    0xFFFFFFFFFF000ULL
+
+// Local APIC registers, as byte offsets
+#define LAPIC_ID   0x020
+#define LAPIC_TPR  0x080
+#define LAPIC_EOI  0x0B0
+#define LAPIC_SVR  0x0F0
+#define LAPIC_ESR  0x280
+#define LAPIC_ICR_LOW  0x300
+#define LAPIC_ICR_HIGH 0x310
+#define LAPIC_LVT_TIMER  0x320
+#define LAPIC_TIMER_INIT 0x380
+#define LAPIC_TIMER_CUR  0x390
+#define LAPIC_TIMER_DIV  0x3E0
+
+#define SVR_ENABLE (1 << 8)
+
+#define ICR_INIT    (5 << 8)
+#define ICR_STARTUP (6 << 8)
+#define ICR_PENDING (1 << 12)
+#define ICR_ASSERT  (1 << 14)
+#define ICR_LEVEL   (1 << 15)
+
+#define LVT_MASKED       (1 << 16)
+#define LVT_TSC_DEADLINE (2 << 17)
+#define TIMER_DIV_16     0x3
+
+#define MSR_TSC_DEADLINE 0x6E0
+#define TIMER_CALIBRATE_NS (10 * 1000 * 1000)
+
+#define IOAPIC_REGSEL   0x00
+#define IOAPIC_WINDOW   0x10
+#define IOAPIC_VER      0x01
+#define IOAPIC_REDTBL   0x10
+
+#define REDIR_LOW_ACTIVE (1 << 13)
+#define REDIR_LEVEL      (1 << 15)
+#define REDIR_MASKED     (1 << 16)
+
+// MPS INTI flags in a source override
+#define ISO_POLARITY_LOW 3
+#define ISO_TRIGGER_LEVEL (3 << 2)
+
+#define MAX_IOAPICS 8
+#define ISA_IRQS    16
+#define NO_GSI      0xFFFFFFFF
+
+struct ioapic {
+    volatile uint32_t *base;
+    uint32_t gsi_base;
+    uint32_t count;
+};
+
+struct isa_route {
+    uint32_t gsi;
+    uint32_t flags;     // REDIR_LOW_ACTIVE / REDIR_LEVEL
+};
+
+static volatile uint32_t *lapic;
+static struct ioapic ioapics[MAX_IOAPICS];
+static unsigned int nr_ioapics;
+static struct isa_route isa_routes[ISA_IRQS];
+static uint32_t cpu_apic_ids[MAX_CPUS];
+static unsigned int nr_apic_cpus;
+static DEFINE_SPINLOCK(ioapic_reg_lock);
+static bool use_tsc_deadline;
+static uint64_t timer_mult;    // APIC timer ticks per nanosecond << TSC_SHIFT
+
+static inline uint32_t lapic_read(uint32_t reg)
+{
+    return lapic[reg / 4];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t value)
+{
+    lapic[reg / 4] = value;
+}
+
+uint32_t lapic_id(void)
+{
+    return lapic_read(LAPIC_ID) >> 24;
+}
+
+void lapic_eoi(void)
+{
+    lapic_write(LAPIC_EOI, 0);
+}
+
+// The select/window pair must not be interleaved
+static uint64_t ioapic_lock(void)
+{
+    return spin_lock_irqsave(&ioapic_reg_lock);
+}
+
+static void ioapic_unlock(uint64_t flags)
+{
+    spin_unlock_irqrestore(&ioapic_reg_lock, flags);
+}
+
+static uint32_t ioapic_read(struct ioapic *io, uint32_t reg)
+{
+    io->base[IOAPIC_REGSEL / 4] = reg;
+    return io->base[IOAPIC_WINDOW / 4];
+}
+
+static void ioapic_write(struct ioapic *io, uint32_t reg, uint32_t value)
+{
+    io->base[IOAPIC_REGSEL / 4] = reg;
+    io->base[IOAPIC_WINDOW / 4] = value;
+}
+
+static struct ioapic *ioapic_for(uint32_t gsi)
+{
+    for (unsigned int i = 0; i < nr_ioapics; i++) {
+        if (gsi >= ioapics[i].gsi_base && gsi < ioapics[i].gsi_base + ioapics[i].count) return &ioapics[i];
+    }
+    return NULL;
+}
+
+static void ioapic_set_masked(uint8_t irq, bool masked)
+{
+    if (irq >= ISA_IRQS) return;
+
+    struct ioapic *io = ioapic_for(isa_routes[irq].gsi);
+    if (!io) return;
+
+    uint32_t reg = IOAPIC_REDTBL + 2 * (isa_routes[irq].gsi - io->gsi_base);
+    uint64_t flags = ioapic_lock();
+    uint32_t low = ioapic_read(io, reg);
+    ioapic_write(io, reg, masked ? low | REDIR_MASKED : low & ~REDIR_MASKED);
+    ioapic_unlock(flags);
+}
+
+void ioapic_mask(uint8_t irq)
+{
+    ioapic_set_masked(irq, true);
+}
+
+void ioapic_unmask(uint8_t irq)
+{
+    ioapic_set_masked(irq, false);
+}
+
+/*
+ * ISA IRQs are identity-mapped, active high and edge triggered unless
+ * the MADT overrides them.
+ */
+static void parse_madt(const struct acpi_madt *madt, uint64_t *lapic_phys)
+{
+    for (int i = 0; i < ISA_IRQS; i++) {
+        isa_routes[i].gsi = i;
+        isa_routes[i].flags = 0;
+    }
+
+    const uint8_t *p = madt->entries;
+    const uint8_t *end = (const uint8_t *)madt + madt->header.length;
+    while (p + sizeof(struct madt_entry) <= end) {
+        const struct madt_entry *e = (const struct madt_entry *)p;
+        if (e->length < sizeof(*e) || p + e->length > end) break;
+
+        if (e->type == MADT_IOAPIC && nr_ioapics < MAX_IOAPICS) {
+            const struct madt_ioapic *m = (const struct madt_ioapic *)e;
+            volatile uint32_t *base = ioremap(m->addr, PAGE_SIZE, PAGE_UC);
+            if (base) {
+                struct ioapic *io = &ioapics[nr_ioapics++];
+                io->base = base;
+                io->gsi_base = m->gsi_base;
+                io->count = ((ioapic_read(io, IOAPIC_VER) >> 16) & 0xFF) + 1;
+            }
+        } else if (e->type == MADT_ISO) {
+            const struct madt_iso *m = (const struct madt_iso *)e;
+            if (m->bus == 0 && m->source < ISA_IRQS) {
+                struct isa_route *r = &isa_routes[m->source];
+                // The IRQ whose pin was taken over (2 for the PIT) is left unrouted
+                if (m->gsi < ISA_IRQS && m->gsi != m->source && isa_routes[m->gsi].gsi == m->gsi) {
+                    isa_routes[m->gsi].gsi = NO_GSI;
+                }
+                r->gsi = m->gsi;
+                r->flags = 0;
+                if ((m->flags & 3) == ISO_POLARITY_LOW) r->flags |= REDIR_LOW_ACTIVE;
+                if ((m->flags & (3 << 2)) == ISO_TRIGGER_LEVEL) r->flags |= REDIR_LEVEL;
+            }
+        } else if (e->type == MADT_LAPIC) {
+            // x2APIC entries (type 9) only matter past APIC ID 254, out of reach in xAPIC mode
+            const struct madt_lapic *m = (const struct madt_lapic *)e;
+            if ((m->flags & (MADT_LAPIC_ENABLED | MADT_LAPIC_ONLINE_CAPABLE)) && nr_apic_cpus < MAX_CPUS) {
+                cpu_apic_ids[nr_apic_cpus++] = m->apic_id;
+            }
+        } else if (e->type == MADT_LAPIC_ADDR) {
+            *lapic_phys = ((const struct madt_lapic_addr *)e)->addr;
+        }
+        p += e->length;
+    }
+}
+
+// Accept every priority; also run on each secondary CPU for its own LAPIC
+void lapic_init_cpu(void)
+{
+    lapic_write(LAPIC_SVR, SVR_ENABLE | SPURIOUS_VECTOR);
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_ESR, 0);
+}
+
+/*
+ * Enable the local APIC and route the ISA IRQs, all masked, to this CPU
+ * on IRQ_VECTOR_BASE + irq. Returns false, leaving the 8259 in charge,
+ * without an APIC or an IOAPIC in the MADT.
+ */
+bool apic_init(void)
+{
+    const struct acpi_madt *madt = (const struct acpi_madt *)acpi_find_table("APIC");
+    if (!cpu_features.apic || !madt) return false;
+
+    uint64_t lapic_phys = madt->lapic_addr;
+    parse_madt(madt, &lapic_phys);
+    if (!nr_ioapics) return false;
+
+    wrmsr(MSR_APIC_BASE, (rdmsr(MSR_APIC_BASE) & ~APIC_BASE_ADDR) | lapic_phys | APIC_BASE_ENABLE);
+    lapic = ioremap(lapic_phys, PAGE_SIZE, PAGE_UC);
+    if (!lapic) return false;
+
+    lapic_init_cpu();
+
+    uint32_t gsis = 0;
+    for (unsigned int i = 0; i < nr_ioapics; i++) {
+        struct ioapic *io = &ioapics[i];
+        for (uint32_t n = 0; n < io->count; n++) {
+            ioapic_write(io, IOAPIC_REDTBL + 2 * n, REDIR_MASKED);
+        }
+        gsis += io->count;
+    }
+
+    uint32_t dest = lapic_id();
+    for (int irq = 0; irq < ISA_IRQS; irq++) {
+        struct ioapic *io = ioapic_for(isa_routes[irq].gsi);
+        if (!io) continue;
+        uint32_t reg = IOAPIC_REDTBL + 2 * (isa_routes[irq].gsi - io->gsi_base);
+        ioapic_write(io, reg + 1, dest << 24);
+        ioapic_write(io, reg, REDIR_MASKED | isa_routes[irq].flags | (IRQ_VECTOR_BASE + irq));
+    }
+
+    printk("apic: LAPIC %u at %lx, %u IOAPIC(s) with %u GSIs\n", dest, lapic_phys, nr_ioapics, gsis);
+    return true;
+}
+
+// Processors the MADT lists, the boot CPU among them; none without an APIC
+unsigned int apic_cpu_count(void)
+{
+    return lapic ? nr_apic_cpus : 0;
+}
+
+uint32_t apic_cpu_id(unsigned int i)
+{
+    return cpu_apic_ids[i];
+}
+
+// The two ICR writes must not be split by an interrupt that sends its own IPI
+static void lapic_send_ipi(uint32_t apic_id, uint32_t icr)
+{
+    uint64_t flags = int_save();
+    lapic_write(LAPIC_ICR_HIGH, apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, icr);
+    while (lapic_read(LAPIC_ICR_LOW) & ICR_PENDING) {
+        asm volatile ("pause");
+    }
+    int_restore(flags);
+}
+
+void lapic_send_init(uint32_t apic_id)
+{
+    lapic_send_ipi(apic_id, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+}
+
+// Fixed delivery: the target takes an interrupt on the vector
+void lapic_send_vector(uint32_t apic_id, uint8_t vector)
+{
+    lapic_send_ipi(apic_id, vector);
+}
+
+// The target starts in real mode at page << 12
+void lapic_send_startup(uint32_t apic_id, uint8_t page)
+{
+    lapic_send_ipi(apic_id, ICR_STARTUP | page);
+}
+
+/*
+ * Use TSC-deadline mode when the CPU has it. Otherwise calibrate the
+ * one-shot count-down timer (bus clock / 16) against the TSC. Needs the
+ * calibrated TSC and the local APIC.
+ */
+bool lapic_timer_init(void)
+{
+    if (!lapic || !tsc_clock.mult) return false;
+
+    if (cpu_features.tsc_deadline) {
+        lapic_write(LAPIC_LVT_TIMER, LVT_TSC_DEADLINE | TIMER_VECTOR);
+        asm volatile ("mfence" : : : "memory"); // order the LVT write before the first deadline
+        use_tsc_deadline = true;
+        return true;
+    }
+
+    lapic_write(LAPIC_TIMER_DIV, TIMER_DIV_16);
+    // The bus clock is shared, so secondary CPUs reuse the boot CPU's rate
+    if (!timer_mult) {
+        lapic_write(LAPIC_LVT_TIMER, LVT_MASKED | TIMER_VECTOR);
+        lapic_write(LAPIC_TIMER_INIT, UINT32_MAX);
+        uint64_t end = ktime_get_ns() + TIMER_CALIBRATE_NS;
+        while (ktime_get_ns() < end) { }
+        uint64_t ticks = UINT32_MAX - lapic_read(LAPIC_TIMER_CUR);
+        lapic_write(LAPIC_TIMER_INIT, 0);
+
+        if (!ticks) return false;
+        timer_mult = (ticks << TSC_SHIFT) / TIMER_CALIBRATE_NS;
+    }
+    lapic_write(LAPIC_LVT_TIMER, TIMER_VECTOR);
+    return true;
+}
+
+const char *lapic_timer_mode(void)
+{
+    return use_tsc_deadline ? "TSC-deadline" : "APIC one-shot";
+}
+
+// A count-down longer than 32 bits fires early; the handler then re-arms
+void lapic_timer_arm(uint64_t expires)
+{
+    if (use_tsc_deadline) {
+        wrmsr(MSR_TSC_DEADLINE, ns_to_tsc(expires));
+        return;
+    }
+
+    uint64_t now = ktime_get_ns();
+    uint64_t delta = expires > now ? expires - now : 0;
+    uint64_t ticks = (uint64_t)(((unsigned __int128)delta * timer_mult) >> TSC_SHIFT);
+    if (ticks == 0) ticks = 1;  // 0 would stop the timer
+    if (ticks > UINT32_MAX) ticks = UINT32_MAX;
+    lapic_write(LAPIC_TIMER_INIT, (uint32_t)ticks);
+}
+
+void lapic_timer_disarm(void)
+{
+    if (use_tsc_deadline) wrmsr(MSR_TSC_DEADLINE, 0);
+    else lapic_write(LAPIC_TIMER_INIT, 0);
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <kernel/cpu.h>
+
+#define XCR0_SSE (1 << 1)
+#define XCR0_AVX (1 << 2)
+
+struct cpu_features cpu_features;
+uint32_t cpu_tsc_khz = 0;
+
+static void detect_tsc_khz(void)
+{
+    uint32_t a, b, c, d;
+
+    // Leaf 0x15: TSC/crystal ratio, crystal frequency in ECX when reported
+    if (cpu_features.max_leaf >= 0x15) {
+        cpuid(0x15, 0, &a, &b, &c, &d);
+        if (a && b && c) {
+            cpu_tsc_khz = (uint32_t)(((uint64_t)c * b / a) / 1000);
+            return;
+        }
+    }
+
+    // Leaf 0x16: processor base frequency in MHz
+    if (cpu_features.max_leaf >= 0x16) {
+        cpuid(0x16, 0, &a, &b, &c, &d);
+        if (a & 0xFFFF) {
+            cpu_tsc_khz = (a & 0xFFFF) * 1000;
+        }
+    }
+}
+
+void cpu_init(void)
+{
+    uint32_t a, b, c, d;
+
+    cpuid(0, 0, &a, &b, &c, &d);
+    cpu_features.max_leaf = a;
+    cpuid(0x80000000, 0, &a, &b, &c, &d);
+    cpu_features.max_ext_leaf = a;
+
+    cpuid(1, 0, &a, &b, &c, &d);
+    cpu_features.sse2 = d & (1 << 26);
+    cpu_features.sse42 = c & (1 << 20);
+    cpu_features.xsave = c & (1 << 26);
+    cpu_features.osxsave = c & (1 << 27);
+    cpu_features.apic = d & (1 << 9);
+    cpu_features.pat = d & (1 << 16);
+    cpu_features.pge = d & (1 << 13);
+    cpu_features.pcid = c & (1 << 17);
+    cpu_features.tsc_deadline = c & (1 << 24);
+    bool avx_hw = c & (1 << 28);
+
+    // AVX is only usable once the OS has enabled the YMM state in XCR0
+    if (avx_hw && cpu_features.osxsave) {
+        uint64_t xcr0 = xgetbv(0);
+        cpu_features.avx = (xcr0 & (XCR0_SSE | XCR0_AVX)) == (XCR0_SSE | XCR0_AVX);
+    }
+
+    if (cpu_features.max_leaf >= 7) {
+        cpuid(7, 0, &a, &b, &c, &d);
+        cpu_features.avx2 = cpu_features.avx && (b & (1 << 5));
+        cpu_features.erms = b & (1 << 9);
+        cpu_features.fsrm = d & (1 << 4);
+        cpu_features.invpcid = b & (1 << 10);
+    }
+
+    if (cpu_features.max_ext_leaf >= 0x80000001) {
+        cpuid(0x80000001, 0, &a, &b, &c, &d);
+        cpu_features.pdpe1gb = d & (1 << 26);
+        cpu_features.nx = d & (1 << 20);
+    }
+
+    if (cpu_features.max_ext_leaf >= 0x80000007) {
+        cpuid(0x80000007, 0, &a, &b, &c, &d);
+        cpu_features.tsc_invariant = d & (1 << 8);
+    }
+
+    detect_tsc_khz();
+}
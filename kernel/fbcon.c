@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <boot/info.h>
+#include <kernel/fbcon.h>
+#include <kernel/font.h>
+#include <kernel/paging.h>
+#include <kernel/lib/string.h>
+
+#define FBCON_MAX_WIDTH  1920
+#define FBCON_MAX_HEIGHT 1080
+
+#define CELL_WIDTH  FONT_WIDTH
+#define CELL_HEIGHT (FONT_HEIGHT * 2) // every font row is drawn twice
+
+#define TILE_SLOTS 8
+
+/*
+ * Glyphs pre-expanded to 32bpp pixels for one fore/back colour pair.
+ * Tiles are built the first time a character is drawn in those colours;
+ * a console only uses a handful of pairs, the least recently used slot
+ * is recycled when a new one shows up.
+ */
+struct glyph_tiles {
+    uint32_t px[FONT_GLYPHS][FONT_HEIGHT][FONT_WIDTH];
+    uint64_t ready[FONT_GLYPHS / 64];
+    uint64_t last_use;
+    uint8_t fore;
+    uint8_t back;
+    bool used;
+};
+
+static struct glyph_tiles tiles[TILE_SLOTS] __attribute__((aligned(64)));
+static struct glyph_tiles *tiles_last = &tiles[0];
+static uint64_t tiles_clock;
+
+// Console image in RAM; scrolling and drawing never read the framebuffer
+static uint32_t back_buf[FBCON_MAX_WIDTH * FBCON_MAX_HEIGHT] __attribute__((aligned(64)));
+
+static uint8_t *fb;
+static size_t fb_pitch;
+static size_t width, height; // console area, clipped to the back buffer
+static size_t text_rows;
+static uint32_t palette[16];
+
+// Pixel rectangle [x0, x1) x [y0, y1) that differs from the framebuffer
+static size_t dirty_x0, dirty_x1, dirty_y0, dirty_y1;
+
+static const uint32_t vga_rgb[16] = {
+    0x000000, 0x0000AA, 0x00AA00, 0x00AAAA, 0xAA0000, 0xAA00AA, 0xAA5500, 0xAAAAAA,
+    0x555555, 0x5555FF, 0x55FF55, 0x55FFFF, 0xFF5555, 0xFF55FF, 0xFFFF55, 0xFFFFFF,
+};
+
+static uint32_t pack_channel(uint32_t v, uint8_t pos, uint8_t size)
+{
+    if (size == 0) return 0;
+    if (size < 8) v >>= 8 - size;
+    return v << pos;
+}
+
+static void dirty_add(size_t x0, size_t x1, size_t y0, size_t y1)
+{
+    if (dirty_x0 >= dirty_x1) {
+        dirty_x0 = x0; dirty_x1 = x1;
+        dirty_y0 = y0; dirty_y1 = y1;
+        return;
+    }
+    if (x0 < dirty_x0) dirty_x0 = x0;
+    if (x1 > dirty_x1) dirty_x1 = x1;
+    if (y0 < dirty_y0) dirty_y0 = y0;
+    if (y1 > dirty_y1) dirty_y1 = y1;
+}
+
+static struct glyph_tiles *tiles_get(uint8_t fore, uint8_t back)
+{
+    struct glyph_tiles *t = tiles_last;
+    if (t->used && t->fore == fore && t->back == back) return t;
+
+    struct glyph_tiles *victim = &tiles[0];
+    for (t = tiles; t < tiles + TILE_SLOTS; t++) {
+        if (t->used && t->fore == fore && t->back == back) goto found;
+        if (!t->used || t->last_use < victim->last_use) victim = t;
+        if (!victim->used) break;
+    }
+
+    t = victim;
+    t->fore = fore;
+    t->back = back;
+    t->used = true;
+    k_memset(t->ready, 0, sizeof(t->ready));
+found:
+    t->last_use = ++tiles_clock;
+    tiles_last = t;
+    return t;
+}
+
+static const uint32_t *glyph_tile(struct glyph_tiles *t, uint8_t c)
+{
+    if (c >= FONT_GLYPHS) c = '?';
+
+    uint64_t bit = 1ULL << (c & 63);
+    if (!(t->ready[c >> 6] & bit)) {
+        uint32_t fg = palette[t->fore], bg = palette[t->back];
+        for (int r = 0; r < FONT_HEIGHT; r++) {
+            uint8_t bits = font_8x8[c][r];
+            for (int x = 0; x < FONT_WIDTH; x++) {
+                t->px[c][r][x] = (bits & (0x80 >> x)) ? fg : bg;
+            }
+        }
+        t->ready[c >> 6] |= bit;
+    }
+    return &t->px[c][0][0];
+}
+
+bool fbcon_init(size_t *cols, size_t *rows)
+{
+    if (!is_graphics_mode || !fb_info) return false;
+    if (fb_info->fb_type != MB2_FB_TYPE_RGB || fb_info->fb_bpp != 32) return false;
+    if (fb_info->fb_addr + (uint64_t)fb_info->fb_pitch * fb_info->fb_height > BOOT_MAP_SIZE) return false;
+
+    fb = phys_to_virt(fb_info->fb_addr);
+    fb_pitch = fb_info->fb_pitch;
+    width = fb_info->fb_width < FBCON_MAX_WIDTH ? fb_info->fb_width : FBCON_MAX_WIDTH;
+    width &= ~(size_t)1; // keep scanlines 8-byte aligned in the back buffer
+    height = fb_info->fb_height < FBCON_MAX_HEIGHT ? fb_info->fb_height : FBCON_MAX_HEIGHT;
+
+    for (int i = 0; i < 16; i++) {
+        uint32_t rgb = vga_rgb[i];
+        palette[i] = pack_channel((rgb >> 16) & 0xFF, fb_info->red_pos, fb_info->red_size)
+                   | pack_channel((rgb >> 8) & 0xFF, fb_info->green_pos, fb_info->green_size)
+                   | pack_channel(rgb & 0xFF, fb_info->blue_pos, fb_info->blue_size);
+    }
+
+    // Start from a black screen
+    k_memset(back_buf, 0, width * height * sizeof(uint32_t));
+    dirty_add(0, width, 0, height);
+    fbcon_flush();
+
+    text_rows = height / CELL_HEIGHT;
+    *cols = width / CELL_WIDTH;
+    *rows = text_rows;
+    return true;
+}
+
+/*
+ * Map the framebuffer write-combining, so scanline copies become burst
+ * writes. Only builds the mapping; fbcon_set_mapping() switches to it.
+ */
+void *fbcon_map_wc(void)
+{
+    if (!fb) return NULL;
+    return ioremap(fb_info->fb_addr, fb_pitch * fb_info->fb_height, PAGE_WC);
+}
+
+void fbcon_set_mapping(void *mapping)
+{
+    fb = mapping;
+}
+
+// Copy the whole console image again; returns the bytes written
+size_t fbcon_refresh(void)
+{
+    if (!fb) return 0;
+
+    dirty_add(0, width, 0, height);
+    fbcon_flush();
+    return width * height * sizeof(uint32_t);
+}
+
+// Move the console image up by whole text lines; the caller redraws the rest
+void fbcon_scroll(size_t lines)
+{
+    if (lines >= text_rows) return;
+
+    size_t shift = lines * CELL_HEIGHT * width;
+    size_t keep = (text_rows - lines) * CELL_HEIGHT * width;
+    k_memmove(back_buf, back_buf + shift, keep * sizeof(uint32_t));
+    dirty_add(0, width, 0, text_rows * CELL_HEIGHT);
+}
+
+void fbcon_draw(size_t y, size_t x0, size_t x1, const uint16_t *cells)
+{
+    uint32_t *row = back_buf + y * CELL_HEIGHT * width;
+
+    for (size_t x = x0; x < x1; x++) {
+        uint16_t cell = cells[x];
+        struct glyph_tiles *t = tiles_get((cell >> 8) & 0x0F, cell >> 12);
+        const uint64_t *src = (const uint64_t *)glyph_tile(t, cell & 0xFF);
+        uint32_t *dst = row + x * CELL_WIDTH;
+
+        // 8 pixels are four 64-bit stores; each font row covers two scanlines
+        for (int r = 0; r < FONT_HEIGHT; r++) {
+            uint64_t *d0 = (uint64_t *)(dst + 2 * r * width);
+            uint64_t *d1 = (uint64_t *)(dst + (2 * r + 1) * width);
+            for (int i = 0; i < FONT_WIDTH / 2; i++) {
+                d0[i] = src[i];
+                d1[i] = src[i];
+            }
+            src += FONT_WIDTH / 2;
+        }
+    }
+
+    dirty_add(x0 * CELL_WIDTH, x1 * CELL_WIDTH, y * CELL_HEIGHT, (y + 1) * CELL_HEIGHT);
+}
+
+// Copy the dirty rectangle to the framebuffer, one wide copy per scanline
+void fbcon_flush(void)
+{
+    if (dirty_x0 >= dirty_x1) return;
+
+    size_t bytes = (dirty_x1 - dirty_x0) * sizeof(uint32_t);
+    for (size_t y = dirty_y0; y < dirty_y1; y++) {
+        k_memcpy(fb + y * fb_pitch + dirty_x0 * sizeof(uint32_t), back_buf + y * width + dirty_x0, bytes);
+    }
+    dirty_x0 = dirty_x1 = 0;
+}
@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <kernel/cpu.h>
+#include <kernel/fpu.h>
+#include <kernel/idt.h>
+#include <kernel/percpu.h>
+#include <kernel/preempt.h>
+#include <kernel/printk.h>
+#include <kernel/sched.h>
+
+#define FXSAVE_SIZE    512
+#define MXCSR_DEFAULT  0x1F80       // all SSE exceptions masked, round to nearest
+#define XSAVE_LEAF     0xD
+#define XSAVEOPT_BIT   (1 << 0)     // CPUID.(0xD,1).EAX
+#define XSAVEC_BIT     (1 << 1)
+
+// What the registers on a CPU hold at the moment
+enum fpu_owner {
+    FPU_FREE,           // nothing anyone needs
+    FPU_THREAD,         // the current thread's section
+    FPU_ATOMIC,         // a section with interrupts off
+    FPU_ATOMIC_SAVED,   // the same, with the thread's state put aside
+};
+
+/*
+ * XSAVEOPT skips components left in their initial state and those not
+ * written since the area was last restored; XSAVEC only the former,
+ * but packs what it saves. Either beats a full XSAVE.
+ */
+enum fpu_insn {
+    FPU_FXSAVE,
+    FPU_XSAVE,
+    FPU_XSAVEC,
+    FPU_XSAVEOPT,
+};
+
+static const char *const insn_names[] = { "fxsave", "xsave", "xsavec", "xsaveopt" };
+
+static DEFINE_PER_CPU(uint8_t, fpu_owner);
+static enum fpu_insn save_insn = FPU_FXSAVE;
+static size_t state_size = FXSAVE_SIZE;
+
+// After cpu_init(); boot.s and the trampoline have set up CR4 and XCR0
+void fpu_init(void)
+{
+    if (cpu_features.osxsave) {
+        uint32_t a, b, c, d;
+        cpuid(XSAVE_LEAF, 0, &a, &b, &c, &d);
+        state_size = b;     // standard layout of what XCR0 enables, enough for XSAVEC too
+        cpuid(XSAVE_LEAF, 1, &a, &b, &c, &d);
+        if (a & XSAVEOPT_BIT) save_insn = FPU_XSAVEOPT;
+        else if (a & XSAVEC_BIT) save_insn = FPU_XSAVEC;
+        else save_insn = FPU_XSAVE;
+    }
+    printk("fpu: %s, %lu byte contexts, saved only for preempted sections\n",
+           insn_names[save_insn], (uint64_t)state_size);
+}
+
+size_t fpu_state_size(void)
+{
+    return state_size;
+}
+
+// Every component enabled in XCR0; area is 64-byte aligned
+void fpu_save(void *area)
+{
+    switch (save_insn) {
+    case FPU_XSAVEOPT:
+        asm volatile ("xsaveopt64 (%0)" : : "r" (area), "a" (0xFFFFFFFF), "d" (0xFFFFFFFF) : "memory");
+        break;
+    case FPU_XSAVEC:
+        asm volatile ("xsavec64 (%0)" : : "r" (area), "a" (0xFFFFFFFF), "d" (0xFFFFFFFF) : "memory");
+        break;
+    case FPU_XSAVE:
+        asm volatile ("xsave64 (%0)" : : "r" (area), "a" (0xFFFFFFFF), "d" (0xFFFFFFFF) : "memory");
+        break;
+    default:
+        asm volatile ("fxsave64 (%0)" : : "r" (area) : "memory");
+        break;
+    }
+}
+
+// XRSTOR reads the standard and the compacted layout alike
+void fpu_restore(const void *area)
+{
+    if (save_insn == FPU_FXSAVE) {
+        asm volatile ("fxrstor64 (%0)" : : "r" (area) : "memory");
+    } else {
+        asm volatile ("xrstor64 (%0)" : : "r" (area), "a" (0xFFFFFFFF), "d" (0xFFFFFFFF) : "memory");
+    }
+}
+
+// Whoever ran last may have left any rounding mode or unmasked exception
+static inline void fpu_reset(void)
+{
+    uint32_t mxcsr = MXCSR_DEFAULT;
+    asm volatile ("ldmxcsr %0" : : "m" (mxcsr));
+}
+
+bool kernel_fpu_begin(void)
+{
+    struct thread *t = thread_current();
+
+    if (t && int_enabled()) {
+        preempt_disable();
+        if (!t->fpu_depth++) {
+            this_cpu_write(fpu_owner, FPU_THREAD);
+            fpu_reset();
+        }
+        preempt_enable();
+        return true;
+    }
+
+    switch (this_cpu_read(fpu_owner)) {
+    case FPU_FREE:
+        this_cpu_write(fpu_owner, FPU_ATOMIC);
+        break;
+    case FPU_THREAD:
+        fpu_save(t->fpu);
+        this_cpu_write(fpu_owner, FPU_ATOMIC_SAVED);
+        break;
+    default:
+        return false;
+    }
+    fpu_reset();
+    return true;
+}
+
+void kernel_fpu_end(void)
+{
+    switch (this_cpu_read(fpu_owner)) {
+    case FPU_ATOMIC:
+        this_cpu_write(fpu_owner, FPU_FREE);
+        return;
+    case FPU_ATOMIC_SAVED:
+        fpu_restore(thread_current()->fpu);
+        this_cpu_write(fpu_owner, FPU_THREAD);
+        return;
+    }
+
+    preempt_disable();
+    if (!--thread_current()->fpu_depth) this_cpu_write(fpu_owner, FPU_FREE);
+    preempt_enable();
+}
+
+// Called by the scheduler, interrupts off, as next takes over this CPU
+void fpu_switch(struct thread *prev, struct thread *next)
+{
+    if (prev->fpu_depth && prev->state != THREAD_DEAD) fpu_save(prev->fpu);
+    if (next->fpu_depth) fpu_restore(next->fpu);
+    this_cpu_write(fpu_owner, next->fpu_depth ? FPU_THREAD : FPU_FREE);
+}
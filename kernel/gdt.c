@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <kernel/gdt.h>
+#include <kernel/percpu.h>
+
+#define IST_STACK_SIZE 8192
+
+struct tss {
+    uint32_t reserved0;
+    uint64_t rsp[3];
+    uint64_t reserved1;
+    uint64_t ist[7];
+    uint64_t reserved2;
+    uint16_t reserved3;
+    uint16_t iomap_base;
+} __attribute__((packed));
+
+struct gdt_ptr {
+    uint16_t limit;
+    uint64_t base;
+} __attribute__((packed));
+
+// Every CPU has its own GDT and TSS: ltr marks the TSS descriptor busy
+static DEFINE_PER_CPU(struct tss, tss);
+static DEFINE_PER_CPU(uint8_t, ist_stacks[3][IST_STACK_SIZE]) __attribute__((aligned(16)));
+
+// Same code and data descriptors as boot.s, plus a 16-byte TSS descriptor
+static DEFINE_PER_CPU(uint64_t, gdt[5]) __attribute__((aligned(16))) = {
+    0,
+    0x0020980000000000, // 64-bit code
+    0x0020920000000000, // data
+};
+
+/*
+ * Replace the boot GDT with this CPU's, which also holds a TSS whose
+ * interrupt stack table gives double faults, NMIs and machine checks a
+ * known good stack. Leaves GS, and so the per-CPU base, alone.
+ */
+void gdt_init(void)
+{
+    struct tss *t = this_cpu_ptr(tss);
+    uint8_t (*stacks)[IST_STACK_SIZE] = *this_cpu_ptr(ist_stacks);
+    uint64_t *g = *this_cpu_ptr(gdt);
+
+    for (int i = 0; i < 3; i++) {
+        t->ist[i] = (uint64_t)(uintptr_t)&stacks[i][IST_STACK_SIZE];
+    }
+    t->iomap_base = sizeof(*t); // no I/O permission bitmap
+
+    uint64_t base = (uint64_t)(uintptr_t)t;
+    uint64_t limit = sizeof(*t) - 1;
+    g[TSS_SEL / 8] = (limit & 0xFFFF) | ((base & 0xFFFFFF) << 16) |
+                     (0x89ULL << 40) | ((limit >> 16) << 48) | ((base >> 24 & 0xFF) << 56);
+    g[TSS_SEL / 8 + 1] = base >> 32;
+
+    struct gdt_ptr gdtr = { sizeof(gdt) - 1, (uint64_t)(uintptr_t)g };
+    asm volatile ("lgdt %0\n\t"
+                  "pushq %1\n\t"
+                  "leaq 1f(%%rip), %%rax\n\t"
+                  "pushq %%rax\n\t"
+                  "lretq\n"
+                  "1:\n\t"
+                  "mov %w2, %%ds\n\t"
+                  "mov %w2, %%es\n\t"
+                  "mov %w2, %%ss\n\t"
+                  "ltr %w3"
+                  : : "m" (gdtr), "i" (KERNEL_CS), "r" (KERNEL_DS), "r" (TSS_SEL)
+                  : "rax", "memory");
+}
@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <kernel/apic.h>
+#include <kernel/cpu.h>
+#include <kernel/hrtimer.h>
+#include <kernel/idt.h>
+#include <kernel/printk.h>
+#include <kernel/spinlock.h>
+#include <kernel/time.h>
+
+/*
+ * Pending timers of one CPU in a binary min-heap on the expiry time.
+ * The LAPIC timer is armed one-shot for the earliest of them and left
+ * off when none is pending, so an idle CPU takes no timer interrupts.
+ */
+struct hrtimer_base {
+    struct hrtimer *heap[HRTIMER_MAX];
+    unsigned int count;
+    spinlock_t lock;
+};
+
+static DEFINE_PER_CPU(struct hrtimer_base, bases);
+static bool hrtimer_ready = false;
+
+static uint64_t base_lock(struct hrtimer_base *base)
+{
+    return spin_lock_irqsave(&base->lock);
+}
+
+static void base_unlock(struct hrtimer_base *base, uint64_t flags)
+{
+    spin_unlock_irqrestore(&base->lock, flags);
+}
+
+static inline void heap_set(struct hrtimer_base *base, unsigned int i, struct hrtimer *timer)
+{
+    base->heap[i] = timer;
+    timer->index = i;
+}
+
+static void sift_up(struct hrtimer_base *base, unsigned int i)
+{
+    struct hrtimer *timer = base->heap[i];
+    while (i > 0) {
+        unsigned int parent = (i - 1) / 2;
+        if (base->heap[parent]->expires <= timer->expires) break;
+        heap_set(base, i, base->heap[parent]);
+        i = parent;
+    }
+    heap_set(base, i, timer);
+}
+
+static void sift_down(struct hrtimer_base *base, unsigned int i)
+{
+    struct hrtimer *timer = base->heap[i];
+    for (;;) {
+        unsigned int child = 2 * i + 1;
+        if (child >= base->count) break;
+        if (child + 1 < base->count && base->heap[child + 1]->expires < base->heap[child]->expires) child++;
+        if (timer->expires <= base->heap[child]->expires) break;
+        heap_set(base, i, base->heap[child]);
+        i = child;
+    }
+    heap_set(base, i, timer);
+}
+
+static void heap_remove(struct hrtimer_base *base, struct hrtimer *timer)
+{
+    unsigned int i = timer->index;
+    struct hrtimer *last = base->heap[--base->count];
+    timer->index = HRTIMER_INACTIVE;
+    if (last == timer) return;
+
+    heap_set(base, i, last);
+    if (i > 0 && base->heap[(i - 1) / 2]->expires > last->expires) sift_up(base, i);
+    else sift_down(base, i);
+}
+
+// Only called for the local CPU's base
+static void reprogram(struct hrtimer_base *base)
+{
+    if (base->count) lapic_timer_arm(base->heap[0]->expires);
+    else lapic_timer_disarm();
+}
+
+static void hrtimer_interrupt(struct int_frame *frame)
+{
+    (void)frame;
+    struct hrtimer_base *base = this_cpu_ptr(bases);
+    uint64_t flags = base_lock(base);
+
+    // Callbacks run unlocked so that they can re-arm their timer
+    uint64_t now = ktime_get_ns();
+    while (base->count && base->heap[0]->expires <= now) {
+        struct hrtimer *timer = base->heap[0];
+        heap_remove(base, timer);
+        base_unlock(base, flags);
+        timer->fn(timer);
+        flags = base_lock(base);
+        now = ktime_get_ns();
+    }
+    reprogram(base);
+
+    base_unlock(base, flags);
+    lapic_eoi();
+}
+
+static void base_init(void)
+{
+    spin_lock_init(&this_cpu_ptr(bases)->lock);
+}
+
+void hrtimer_init(void)
+{
+    base_init();
+    if (!lapic_timer_init()) {
+        printk(KERN_WARN "hrtimer: no LAPIC timer, timers are unavailable\n");
+        return;
+    }
+
+    int_register(TIMER_VECTOR, hrtimer_interrupt);
+    hrtimer_ready = true;
+    printk("hrtimer: tickless, %s\n", lapic_timer_mode());
+}
+
+// Secondary CPUs only need their own LAPIC timer programmed
+void hrtimer_init_cpu(void)
+{
+    base_init();
+    if (hrtimer_ready) lapic_timer_init();
+}
+
+void hrtimer_setup(struct hrtimer *timer, hrtimer_fn_t fn)
+{
+    timer->fn = fn;
+    timer->expires = 0;
+    timer->index = HRTIMER_INACTIVE;
+    timer->cpu = 0;
+}
+
+/*
+ * Queue (or move) the timer on this CPU to fire at expires. Returns
+ * false without timer hardware or with HRTIMER_MAX timers pending.
+ */
+bool hrtimer_start(struct hrtimer *timer, uint64_t expires)
+{
+    if (!hrtimer_ready) return false;
+
+    // Stay on one CPU from choosing its base to queueing on it
+    preempt_disable();
+    hrtimer_cancel(timer);
+
+    struct hrtimer_base *base = this_cpu_ptr(bases);
+    uint64_t flags = base_lock(base);
+    if (base->count == HRTIMER_MAX) {
+        base_unlock(base, flags);
+        preempt_enable();
+        return false;
+    }
+
+    timer->expires = expires;
+    timer->cpu = cpu_id();
+    heap_set(base, base->count++, timer);
+    sift_up(base, timer->index);
+    if (timer->index == 0) reprogram(base);
+
+    base_unlock(base, flags);
+    preempt_enable();
+    return true;
+}
+
+// Returns whether the timer was pending; a running callback is not waited for
+bool hrtimer_cancel(struct hrtimer *timer)
+{
+    if (!hrtimer_active(timer)) return false;
+
+    struct hrtimer_base *base = per_cpu_ptr(bases, timer->cpu);
+    uint64_t flags = base_lock(base);
+    bool pending = hrtimer_active(timer);
+    if (pending) {
+        bool first = timer->index == 0;
+        heap_remove(base, timer);
+        // A remote CPU finds the early interrupt empty and re-arms itself
+        if (first && timer->cpu == cpu_id()) reprogram(base);
+    }
+    base_unlock(base, flags);
+    return pending;
+}
@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <kernel/cpu.h>
+#include <kernel/gdt.h>
+#include <kernel/idt.h>
+#include <kernel/printk.h>
+#include <kernel/sched.h>
+#include <kernel/smp.h>
+
+struct idt_entry {
+    uint16_t offset_lo;
+    uint16_t selector;
+    uint8_t ist;
+    uint8_t type_attr;
+    uint16_t offset_mid;
+    uint32_t offset_hi;
+    uint32_t reserved;
+} __attribute__((packed));
+
+struct idt_ptr {
+    uint16_t limit;
+    uint64_t base;
+} __attribute__((packed));
+
+struct int_stat {
+    uint64_t count;
+    uint64_t max_cycles;    // longest time spent in the handler
+};
+
+extern uint64_t isr_stub_table[IDT_ENTRIES];
+
+static struct idt_entry idt[IDT_ENTRIES] __attribute__((aligned(16)));
+static int_handler_t int_handlers[IDT_ENTRIES];
+static DEFINE_PER_CPU(struct int_stat, int_stats[IDT_ENTRIES]);
+
+static const char *const exception_names[EXCEPTION_COUNT] = {
+    [0] = "divide error",
+    [1] = "debug",
+    [2] = "NMI",
+    [3] = "breakpoint",
+    [4] = "overflow",
+    [5] = "bound range exceeded",
+    [6] = "invalid opcode",
+    [7] = "device not available",
+    [8] = "double fault",
+    [9] = "coprocessor segment overrun",
+    [10] = "invalid TSS",
+    [11] = "segment not present",
+    [12] = "stack fault",
+    [13] = "general protection fault",
+    [14] = "page fault",
+    [16] = "x87 floating point error",
+    [17] = "alignment check",
+    [18] = "machine check",
+    [19] = "SIMD floating point error",
+    [20] = "virtualization exception",
+    [21] = "control protection",
+    [28] = "hypervisor injection",
+    [29] = "VMM communication",
+    [30] = "security exception",
+};
+
+static void idt_set_gate(uint8_t vector, uint64_t handler, uint8_t ist, uint8_t type_attr)
+{
+    struct idt_entry *e = &idt[vector];
+    e->offset_lo = handler & 0xFFFF;
+    e->selector = KERNEL_CS;
+    e->ist = ist;
+    e->type_attr = type_attr;
+    e->offset_mid = (handler >> 16) & 0xFFFF;
+    e->offset_hi = (uint32_t)(handler >> 32);
+    e->reserved = 0;
+}
+
+void idt_init(void)
+{
+    // Present, DPL 0, 64-bit interrupt gate (IF cleared on entry)
+    for (int i = 0; i < IDT_ENTRIES; i++) {
+        idt_set_gate((uint8_t)i, isr_stub_table[i], 0, 0x8E);
+    }
+    idt[2].ist = IST_NMI;
+    idt[8].ist = IST_DOUBLE_FAULT;
+    idt[18].ist = IST_MACHINE_CHECK;
+    idt_load();
+}
+
+// The table is shared; each CPU loads it once
+void idt_load(void)
+{
+    struct idt_ptr idtr = { sizeof(idt) - 1, (uint64_t)idt };
+    asm volatile ("lidt %0" : : "m" (idtr));
+}
+
+void int_register(uint8_t vector, int_handler_t handler)
+{
+    int_handlers[vector] = handler;
+}
+
+static __attribute__((noreturn)) void fatal_exception(struct int_frame *frame)
+{
+    const char *name = exception_names[frame->vector];
+
+    printk(KERN_EMERG "%s (vector %lu, error %lx) at %lx\n", name ? name : "reserved exception",
+           frame->vector, frame->error_code, frame->rip);
+    if (frame->vector == 14) {
+        uint64_t cr2;
+        asm volatile ("mov %%cr2, %0" : "=r" (cr2));
+        printk(KERN_EMERG "  %s of %lx, %s page, %s mode%s\n",
+               (frame->error_code & 2) ? "write" : (frame->error_code & 16) ? "fetch" : "read", cr2,
+               (frame->error_code & 1) ? "present" : "missing",
+               (frame->error_code & 4) ? "user" : "kernel",
+               (frame->error_code & 8) ? ", reserved bit set" : "");
+    }
+    printk(KERN_EMERG "  rax %016lx rbx %016lx rcx %016lx rdx %016lx\n", frame->rax, frame->rbx, frame->rcx, frame->rdx);
+    printk(KERN_EMERG "  rsi %016lx rdi %016lx rbp %016lx rsp %016lx\n", frame->rsi, frame->rdi, frame->rbp, frame->rsp);
+    printk(KERN_EMERG "  r8  %016lx r9  %016lx r10 %016lx r11 %016lx\n", frame->r8, frame->r9, frame->r10, frame->r11);
+    printk(KERN_EMERG "  r12 %016lx r13 %016lx r14 %016lx r15 %016lx\n", frame->r12, frame->r13, frame->r14, frame->r15);
+    printk(KERN_EMERG "  cs %lx ss %lx rflags %lx\n", frame->cs, frame->ss, frame->rflags);
+    for (;;) asm volatile ("cli; hlt");
+}
+
+// Called from the entry stubs with the saved register frame
+void int_dispatch(struct int_frame *frame)
+{
+    int_handler_t handler = int_handlers[frame->vector];
+    if (!handler) {
+        if (frame->vector < EXCEPTION_COUNT) fatal_exception(frame);
+        return;
+    }
+
+    uint64_t start = rdtsc();
+    handler(frame);
+    uint64_t cycles = rdtsc() - start;
+
+    struct int_stat *st = &(*this_cpu_ptr(int_stats))[frame->vector];
+    st->count++;
+    if (cycles > st->max_cycles) st->max_cycles = cycles;
+
+    // Switch threads on the way out if the handler asked and the interrupted code allows it
+    if (frame->vector >= EXCEPTION_COUNT && (frame->rflags & (1 << 9))) sched_preempt_irq();
+}
+
+// Every vector that has fired, summed over CPUs
+void int_report(void)
+{
+    for (int v = 0; v < IDT_ENTRIES; v++) {
+        uint64_t count = 0, max = 0;
+        for (unsigned int cpu = 0; cpu < nr_cpus; cpu++) {
+            const struct int_stat *st = &(*per_cpu_ptr(int_stats, cpu))[v];
+            count += st->count;
+            if (st->max_cycles > max) max = st->max_cycles;
+        }
+        if (count) printk("int: vector %#x: %lu, longest %lu cycles\n", v, count, max);
+    }
+}
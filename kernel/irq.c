@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <kernel/apic.h>
+#include <kernel/idt.h>
+#include <kernel/irq.h>
+#include <kernel/pic.h>
+#include <kernel/printk.h>
+
+#define ISA_IRQS 16
+
+static int_handler_t irq_handlers[ISA_IRQS];
+static bool use_apic = false;
+
+static void apic_irq_dispatch(struct int_frame *frame)
+{
+    int_handler_t handler = irq_handlers[frame->vector - IRQ_VECTOR_BASE];
+    if (handler) handler(frame);
+    lapic_eoi();
+}
+
+/*
+ * The PIC is always remapped first so that its spurious interrupts stay
+ * clear of the exception vectors, then masked if the APICs take over.
+ */
+void irq_init(void)
+{
+    pic_init();
+    if (!apic_init()) {
+        printk("irq: using the 8259 PIC\n");
+        return;
+    }
+
+    pic_disable();
+    for (uint8_t irq = 0; irq < ISA_IRQS; irq++) {
+        int_register(IRQ_VECTOR_BASE + irq, apic_irq_dispatch);
+    }
+    use_apic = true;
+}
+
+void irq_register(uint8_t irq, int_handler_t handler)
+{
+    if (use_apic) irq_handlers[irq] = handler;
+    else pic_register(irq, handler);
+}
+
+void irq_mask(uint8_t irq)
+{
+    if (use_apic) ioapic_mask(irq);
+    else pic_mask(irq);
+}
+
+void irq_unmask(uint8_t irq)
+{
+    if (use_apic) ioapic_unmask(irq);
+    else pic_unmask(irq);
+}
@@ -0,0 +1,110 @@
+;
+; Copyright (C) 2025 Roy Roy123ty@hotmail.com
+;
+; This file is part of Solum OS
+;
+; This program is free software: you can redistribute it and/or modify
+; it under the terms of the GNU General Public License as published by
+; the Free Software Foundation, either version 3 of the License, or
+; (at your option) any later version.
+;
+; This program is distributed in the hope that it will be useful,
+; but WITHOUT ANY WARRANTY; without even the implied warranty of
+; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+; GNU General Public License for more details.
+;
+; You should have received a copy of the GNU General Public License
+; along with this program.  If not, see <http://www.gnu.org/licenses/>.
+;
+
+bits 64
+section .text
+
+extern int_dispatch
+
+; Every stub leaves the same layout on the stack: vector, error code (0 when
+; the CPU does not push one), then the CPU's interrupt frame. Exceptions
+; save every register for the fault report; interrupts only the ones a C
+; handler may clobber, leaving the callee-saved slots of int_frame unset.
+%assign i 0
+%rep 256
+isr_stub_%+i:
+%if i == 8 || (i >= 10 && i <= 14) || i == 17 || i == 21 || i == 29 || i == 30
+%else
+    push qword 0
+%endif
+    push qword i
+%if i < 32
+    jmp exception_common
+%else
+    jmp irq_common
+%endif
+%assign i i + 1
+%endrep
+
+exception_common:
+    push rax
+    push rcx
+    push rdx
+    push rsi
+    push rdi
+    push r8
+    push r9
+    push r10
+    push r11
+    push rbx
+    push rbp
+    push r12
+    push r13
+    push r14
+    push r15
+    mov rdi, rsp
+    cld
+    call int_dispatch
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop rbp
+    pop rbx
+    jmp int_return
+
+irq_common:
+    push rax
+    push rcx
+    push rdx
+    push rsi
+    push rdi
+    push r8
+    push r9
+    push r10
+    push r11
+    sub rsp, 6 * 8
+    mov rdi, rsp
+    cld
+    call int_dispatch
+    add rsp, 6 * 8
+
+int_return:
+    pop r11
+    pop r10
+    pop r9
+    pop r8
+    pop rdi
+    pop rsi
+    pop rdx
+    pop rcx
+    pop rax
+    add rsp, 16
+    iretq
+
+section .data
+align 8
+
+global isr_stub_table
+isr_stub_table:
+%assign i 0
+%rep 256
+    dq isr_stub_%+i
+%assign i i + 1
+%endrep
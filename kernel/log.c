@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <kernel/log.h>
+#include <kernel/spinlock.h>
+#include <kernel/lib/string.h>
+
+/*
+ * Records are laid out back to back in log_buf, each padded to 8 bytes.
+ * A record header with size 0 marks the point where the writer wrapped
+ * to the start of the buffer. When space runs out the oldest records
+ * are dropped; readers that were still behind them notice through seq.
+ */
+struct log_record {
+    uint64_t seq;
+    uint64_t tsc;
+    uint16_t size;  // header + text, padded; 0 = wrapped
+    uint16_t len;   // text length
+    uint8_t level;
+};
+
+#define LOG_HDR_SIZE sizeof(struct log_record)
+
+static uint8_t log_buf[LOG_BUF_SIZE] __attribute__((aligned(8)));
+static uint64_t first_seq;  // oldest record still in the buffer
+static uint32_t first_idx;
+static uint64_t next_seq;   // record the next store will create
+static uint32_t next_idx;
+// Interrupt handlers log too
+static DEFINE_SPINLOCK(log_lock);
+
+static inline struct log_record *record_at(uint32_t idx)
+{
+    struct log_record *rec = (struct log_record *)(log_buf + idx);
+    // Wrap marker: the record really lives at the start of the buffer
+    if (rec->size == 0) rec = (struct log_record *)log_buf;
+    return rec;
+}
+
+static inline uint32_t record_next(uint32_t idx)
+{
+    struct log_record *rec = record_at(idx);
+    return (uint32_t)((uint8_t *)rec - log_buf) + rec->size;
+}
+
+static bool has_space(uint32_t size, bool empty)
+{
+    // Always keep room for a wrap marker behind the new record
+    if (next_idx > first_idx || empty) {
+        if (LOG_BUF_SIZE - next_idx >= size + LOG_HDR_SIZE) return true;
+        if (first_idx >= size + LOG_HDR_SIZE) return true;
+    } else if (next_idx + size + LOG_HDR_SIZE <= first_idx) {
+        return true;
+    }
+    return false;
+}
+
+uint64_t log_store(int level, uint64_t tsc, const char *text, size_t len)
+{
+    if (len > LOG_TEXT_MAX) len = LOG_TEXT_MAX;
+    uint32_t size = (uint32_t)((LOG_HDR_SIZE + len + 7) & ~(size_t)7);
+
+    uint64_t flags = spin_lock_irqsave(&log_lock);
+
+    while (first_seq < next_seq && !has_space(size, false)) {
+        first_idx = record_next(first_idx);
+        first_seq++;
+    }
+    if (next_idx + size + LOG_HDR_SIZE > LOG_BUF_SIZE) {
+        k_memset(log_buf + next_idx, 0, LOG_HDR_SIZE);
+        next_idx = 0;
+    }
+
+    struct log_record *rec = (struct log_record *)(log_buf + next_idx);
+    rec->seq = next_seq;
+    rec->tsc = tsc;
+    rec->size = (uint16_t)size;
+    rec->len = (uint16_t)len;
+    rec->level = (uint8_t)level;
+    k_memcpy(rec + 1, text, len);
+
+    uint64_t seq = next_seq++;
+    next_idx += size;
+
+    spin_unlock_irqrestore(&log_lock, flags);
+    return seq;
+}
+
+void log_reader_init(struct log_reader *r, bool from_oldest)
+{
+    uint64_t flags = spin_lock_irqsave(&log_lock);
+    r->seq = from_oldest ? first_seq : next_seq;
+    r->idx = from_oldest ? first_idx : next_idx;
+    r->lost = 0;
+    spin_unlock_irqrestore(&log_lock, flags);
+}
+
+// Copy the reader's next record into buf (truncated to size), and advance
+bool log_read(struct log_reader *r, struct log_entry *e, char *buf, size_t size)
+{
+    uint64_t flags = spin_lock_irqsave(&log_lock);
+
+    if (r->seq < first_seq) {
+        r->lost += first_seq - r->seq;
+        r->seq = first_seq;
+        r->idx = first_idx;
+    }
+    if (r->seq >= next_seq) {
+        spin_unlock_irqrestore(&log_lock, flags);
+        return false;
+    }
+
+    struct log_record *rec = record_at(r->idx);
+    size_t len = (rec->len < size) ? rec->len : size;
+    k_memcpy(buf, rec + 1, len);
+    e->seq = rec->seq;
+    e->tsc = rec->tsc;
+    e->level = rec->level;
+    e->len = len;
+
+    r->idx = record_next(r->idx);
+    r->seq++;
+
+    spin_unlock_irqrestore(&log_lock, flags);
+    return true;
+}
+
+uint64_t log_first_seq(void)
+{
+    return __atomic_load_n(&first_seq, __ATOMIC_RELAXED);
+}
+
+uint64_t log_next_seq(void)
+{
+    return __atomic_load_n(&next_seq, __ATOMIC_RELAXED);
+}
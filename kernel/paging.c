@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <kernel/cpu.h>
+#include <kernel/paging.h>
+#include <kernel/pmm.h>
+#include <kernel/printk.h>
+#include <kernel/vmm.h>
+#include <kernel/lib/string.h>
+
+#define MSR_PAT 0x277
+
+#define PAT_UC       0x00
+#define PAT_WC       0x01
+#define PAT_WT       0x04
+#define PAT_WP       0x05
+#define PAT_WB       0x06
+#define PAT_UC_MINUS 0x07
+
+#define PAT_ENTRY(i, type) ((uint64_t)(type) << ((i) * 8))
+
+extern char kernel_start[];
+extern char kernel_end[];
+
+static uint64_t *alloc_table(void)
+{
+    uint64_t phys = pmm_alloc_page(PMM_ZERO);
+    return phys ? phys_to_virt(phys) : NULL;
+}
+
+// The table an entry points to, allocated if the entry is empty
+static uint64_t *next_table(uint64_t *entry)
+{
+    if (!*entry) {
+        uint64_t *table = alloc_table();
+        if (!table) return NULL;
+        *entry = virt_to_phys(table) | PTE_PRESENT | PTE_WRITE;
+    }
+    return table_at(*entry);
+}
+
+/*
+ * Same layout as Linux: the first four entries are WB, WC, UC-, UC and
+ * the upper four (PAT bit set) are never selected by this kernel.
+ * The boot map only uses entry 0, so changing entry 1 is safe here.
+ */
+void pat_init(void)
+{
+    if (!cpu_features.pat) return;
+
+    wrmsr(MSR_PAT, PAT_ENTRY(0, PAT_WB) | PAT_ENTRY(1, PAT_WC) |
+                   PAT_ENTRY(2, PAT_UC_MINUS) | PAT_ENTRY(3, PAT_UC) |
+                   PAT_ENTRY(4, PAT_WB) | PAT_ENTRY(5, PAT_WP) |
+                   PAT_ENTRY(6, PAT_UC_MINUS) | PAT_ENTRY(7, PAT_WT));
+}
+
+/*
+ * Replace a large mapping by a table of the next smaller pages with the
+ * same attributes: 1 GiB -> 2 MiB keeps the PAT bit at bit 12, 2 MiB ->
+ * 4 KiB moves it to bit 7.
+ */
+uint64_t *split_large_page(uint64_t *entry, uint64_t size)
+{
+    uint64_t *table = alloc_table();
+    if (!table) return NULL;
+
+    uint64_t step = size / 512;
+    uint64_t flags = *entry & ~(PTE_ADDR | PTE_HUGE | PTE_PAT_HUGE);
+    if (step == PAGE_SIZE) {
+        if (*entry & PTE_PAT_HUGE) flags |= PTE_PAT;
+    } else {
+        flags |= PTE_HUGE | (*entry & PTE_PAT_HUGE);
+    }
+
+    uint64_t base = *entry & PTE_ADDR & ~(size - 1);
+    for (int i = 0; i < 512; i++) {
+        table[i] = (base + (uint64_t)i * step) | flags;
+    }
+    *entry = virt_to_phys(table) | PTE_PRESENT | PTE_WRITE;
+    return table;
+}
+
+/*
+ * Build the kernel page tables: all RAM (and at least the low 4 GiB with
+ * its MMIO) at PAGE_OFFSET and the kernel image at KERNEL_VMA, as global
+ * pages. Gigabytes that are entirely RAM use 1 GiB pages when the CPU
+ * has them, the rest 2 MiB pages. Nothing is identity mapped. RAM above
+ * 4 GiB is handed to the page allocator once it is reachable.
+ */
+void paging_init(void)
+{
+    uint64_t end = pmm_max_addr();
+    if (end < BOOT_MAP_SIZE) end = BOOT_MAP_SIZE;
+    end = (end + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+
+    // Up to slot 510; 511 is left for the kernel image
+    uint64_t first_slot = (PAGE_OFFSET >> 39) & 511;
+    if (end > (511 - first_slot) << 39) end = (511 - first_slot) << 39;
+
+    bool gb = cpu_features.pdpe1gb;
+    uint64_t huge = 0;
+    uint64_t *pml4 = alloc_table();
+    if (!pml4) goto fail;
+
+    for (uint64_t addr = 0; addr < end; addr += HUGE_PAGE_SIZE) {
+        uint64_t virt = (uint64_t)(uintptr_t)phys_to_virt(addr);
+        uint64_t *pdpt = next_table(&pml4[(virt >> 39) & 511]);
+        if (!pdpt) goto fail;
+
+        // A 1 GiB page must not straddle RAM and MMIO with other MTRR types
+        uint64_t *pdpte = &pdpt[(virt >> 30) & 511];
+        if (gb && pmm_is_ram(addr, addr + HUGE_PAGE_SIZE)) {
+            *pdpte = addr | PTE_PRESENT | PTE_WRITE | PTE_HUGE | PTE_GLOBAL;
+            huge++;
+            continue;
+        }
+
+        uint64_t *pd = alloc_table();
+        if (!pd) goto fail;
+        for (int i = 0; i < 512; i++) {
+            pd[i] = (addr + (uint64_t)i * LARGE_PAGE_SIZE) | PTE_PRESENT | PTE_WRITE | PTE_HUGE | PTE_GLOBAL;
+        }
+        *pdpte = virt_to_phys(pd) | PTE_PRESENT | PTE_WRITE;
+    }
+
+    uint64_t image = ((uint64_t)(uintptr_t)kernel_start - KERNEL_VMA) & ~(uint64_t)(LARGE_PAGE_SIZE - 1);
+    for (; image < (uint64_t)(uintptr_t)kernel_end - KERNEL_VMA; image += LARGE_PAGE_SIZE) {
+        uint64_t virt = KERNEL_VMA + image;
+        uint64_t *pdpt = next_table(&pml4[(virt >> 39) & 511]);
+        uint64_t *pd = pdpt ? next_table(&pdpt[(virt >> 30) & 511]) : NULL;
+        if (!pd) goto fail;
+        pd[(virt >> 21) & 511] = image | PTE_PRESENT | PTE_WRITE | PTE_HUGE | PTE_GLOBAL;
+    }
+
+    write_cr3(virt_to_phys(pml4));
+
+    pmm_add_memory(BOOT_MAP_SIZE, UINT64_MAX);
+    printk("paging: direct map of %lu GiB, %lu GiB in 1 GiB pages\n", end >> 30, huge);
+    return;
+
+fail:
+    // Tables already taken stay allocated; the boot map remains in use
+    printk(KERN_ERR "paging: out of memory for the direct map\n");
+}
+
+/*
+ * Give [phys, phys + size) the requested memory type in the direct map
+ * and return its direct-map address.
+ * Whole large pages are retyped in place, partial ones are split first.
+ * Returns NULL for ranges the map does not cover. Needs the PMM.
+ * Every online CPU is flushed, so the caller must not hold a spinlock.
+ */
+void *ioremap(uint64_t phys, size_t size, enum page_cache cache)
+{
+    if (size == 0) return NULL;
+
+    // Without PAT, index 1 means write-through; uncached is the safe choice
+    if (!cpu_features.pat && (cache == PAGE_WC || cache == PAGE_UC_MINUS)) cache = PAGE_UC;
+
+    uint64_t *pml4 = table_at(read_cr3());
+    uint64_t addr = phys & ~(uint64_t)(PAGE_SIZE - 1);
+    uint64_t end = (phys + size + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+    uint64_t clear = PTE_PWT | PTE_PCD;
+
+    while (addr < end) {
+        uint64_t virt = (uint64_t)(uintptr_t)phys_to_virt(addr);
+        uint64_t *pml4e = &pml4[(virt >> 39) & 511];
+        if (!(*pml4e & PTE_PRESENT)) return NULL;
+
+        uint64_t *pdpte = &table_at(*pml4e)[(virt >> 30) & 511];
+        if (!(*pdpte & PTE_PRESENT)) return NULL;
+        if (*pdpte & PTE_HUGE) {
+            if (!(addr & (HUGE_PAGE_SIZE - 1)) && end - addr >= HUGE_PAGE_SIZE) {
+                *pdpte = (*pdpte & ~(clear | PTE_PAT_HUGE)) | pte_cache_bits(cache);
+                addr += HUGE_PAGE_SIZE;
+                continue;
+            }
+            if (!split_large_page(pdpte, HUGE_PAGE_SIZE)) return NULL;
+        }
+
+        uint64_t *pde = &table_at(*pdpte)[(virt >> 21) & 511];
+        if (!(*pde & PTE_PRESENT)) return NULL;
+        if (*pde & PTE_HUGE) {
+            if (!(addr & (LARGE_PAGE_SIZE - 1)) && end - addr >= LARGE_PAGE_SIZE) {
+                *pde = (*pde & ~(clear | PTE_PAT_HUGE)) | pte_cache_bits(cache);
+                addr += LARGE_PAGE_SIZE;
+                continue;
+            }
+            if (!split_large_page(pde, LARGE_PAGE_SIZE)) return NULL;
+        }
+
+        uint64_t *pte = &table_at(*pde)[(virt >> 12) & 511];
+        *pte = (*pte & ~(clear | PTE_PAT)) | pte_cache_bits(cache);
+        addr += PAGE_SIZE;
+    }
+
+    // Drop lines cached under the old type, then every stale translation
+    flush_tlb_all_cpus(true);
+
+    return phys_to_virt(phys);
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <kernel/pic.h>
+#include <kernel/idt.h>
+#include <kernel/port.h>
+
+#define PIC1_CMD  0x20
+#define PIC1_DATA 0x21
+#define PIC2_CMD  0xA0
+#define PIC2_DATA 0xA1
+#define PIC_EOI   0x20
+#define PIC_READ_ISR 0x0B
+
+static int_handler_t irq_handlers[16];
+static uint16_t irq_mask = 0xFFFF;
+
+static void pic_write_mask(void)
+{
+    outb(PIC1_DATA, irq_mask & 0xFF);
+    outb(PIC2_DATA, irq_mask >> 8);
+}
+
+// A spurious IRQ 7/15 has no bit set in the in-service register
+static int pic_is_spurious(uint8_t irq)
+{
+    if (irq == 7) {
+        outb(PIC1_CMD, PIC_READ_ISR);
+        return !(inb(PIC1_CMD) & 0x80);
+    }
+    if (irq == 15) {
+        outb(PIC2_CMD, PIC_READ_ISR);
+        if (!(inb(PIC2_CMD) & 0x80)) {
+            outb(PIC1_CMD, PIC_EOI); // the master did see the cascade
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void pic_dispatch(struct int_frame *frame)
+{
+    uint8_t irq = (uint8_t)(frame->vector - PIC_IRQ_BASE);
+
+    if (pic_is_spurious(irq)) return;
+
+    if (irq_handlers[irq]) irq_handlers[irq](frame);
+
+    if (irq >= 8) outb(PIC2_CMD, PIC_EOI);
+    outb(PIC1_CMD, PIC_EOI);
+}
+
+void pic_init(void)
+{
+    outb(PIC1_CMD, 0x11);               // ICW1: init, expect ICW4
+    outb(PIC2_CMD, 0x11);
+    outb(PIC1_DATA, PIC_IRQ_BASE);      // ICW2: vector offsets
+    outb(PIC2_DATA, PIC_IRQ_BASE + 8);
+    outb(PIC1_DATA, 0x04);              // ICW3: slave on IRQ2
+    outb(PIC2_DATA, 0x02);
+    outb(PIC1_DATA, 0x01);              // ICW4: 8086 mode
+    outb(PIC2_DATA, 0x01);
+
+    irq_mask = 0xFFFF & ~(1 << 2);      // everything masked but the cascade
+    pic_write_mask();
+
+    for (uint8_t irq = 0; irq < 16; irq++) {
+        int_register(PIC_IRQ_BASE + irq, pic_dispatch);
+    }
+}
+
+// Mask every line, the cascade included, once the IOAPIC takes over
+void pic_disable(void)
+{
+    irq_mask = 0xFFFF;
+    pic_write_mask();
+}
+
+void pic_register(uint8_t irq, int_handler_t handler)
+{
+    irq_handlers[irq] = handler;
+}
+
+void pic_mask(uint8_t irq)
+{
+    irq_mask |= (uint16_t)(1 << irq);
+    pic_write_mask();
+}
+
+void pic_unmask(uint8_t irq)
+{
+    irq_mask &= (uint16_t)~(1 << irq);
+    pic_write_mask();
+}
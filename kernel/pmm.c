@@ -0,0 +1,534 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <boot/info.h>
+#include <kernel/cpu.h>
+#include <kernel/idt.h>
+#include <kernel/paging.h>
+#include <kernel/pmm.h>
+#include <kernel/printk.h>
+#include <kernel/spinlock.h>
+#include <kernel/vsnprintf.h>
+#include <kernel/lib/string.h>
+
+#define LOW_MEMORY     0x100000ULL    // BIOS data, VGA and option ROMs
+#define DMA_LIMIT_PFN   (0x1000000ULL >> PAGE_SHIFT)
+#define DMA32_LIMIT_PFN (0x100000000ULL >> PAGE_SHIFT)
+
+#define MAX_RESERVED 16
+
+// Per-CPU hot page cache: pages go back to the zones PCP_BATCH at a time
+#define PCP_HIGH  64
+#define PCP_BATCH 16
+
+/*
+ * Buddy allocator per zone. A free block is linked into free_list[order]
+ * through its first bytes (accessed via the direct map), and its bit in
+ * free_map[order] is set, so checking whether a buddy is free is one bit
+ * test. nonempty has bit k set while free_list[k] is not empty; the
+ * smallest usable order is found with a single ctz.
+ */
+struct free_block {
+    struct free_block *next;
+    struct free_block *prev;
+};
+
+struct zone {
+    const char *name;
+    uint64_t start_pfn;     // aligned to the largest block
+    uint64_t end_pfn;
+    uint64_t managed_pages;
+    uint64_t free_pages;
+    uint32_t nonempty;
+    spinlock_t lock;
+    struct free_block free_list[PMM_MAX_ORDER];
+    uint64_t *free_map[PMM_MAX_ORDER];
+};
+
+struct pcp_cache {
+    unsigned int count;
+    uint64_t pfns[PCP_HIGH]; // hottest page last
+} __attribute__((aligned(64)));
+
+struct phys_range {
+    uint64_t start;
+    uint64_t end;
+};
+
+extern char kernel_start[];
+extern char kernel_end[];
+
+static struct zone zones[ZONE_COUNT] = {
+    [ZONE_DMA] = { .name = "DMA" },
+    [ZONE_DMA32] = { .name = "DMA32" },
+    [ZONE_NORMAL] = { .name = "Normal" },
+};
+static struct pcp_cache pcp[MAX_CPUS];
+
+static uint64_t max_pfn;
+static struct phys_range reserved[MAX_RESERVED];
+static int reserved_count = 0;
+
+static inline uint64_t align_up(uint64_t v, uint64_t a)
+{
+    return (v + a - 1) & ~(a - 1);
+}
+
+static inline uint64_t align_down(uint64_t v, uint64_t a)
+{
+    return v & ~(a - 1);
+}
+
+static inline bool test_bit(const uint64_t *map, uint64_t i)
+{
+    return (map[i >> 6] >> (i & 63)) & 1;
+}
+
+static inline void set_bit(uint64_t *map, uint64_t i)
+{
+    map[i >> 6] |= 1ULL << (i & 63);
+}
+
+static inline void clear_bit(uint64_t *map, uint64_t i)
+{
+    map[i >> 6] &= ~(1ULL << (i & 63));
+}
+
+static uint64_t zone_lock(struct zone *z)
+{
+    return spin_lock_irqsave(&z->lock);
+}
+
+static void zone_unlock(struct zone *z, uint64_t flags)
+{
+    spin_unlock_irqrestore(&z->lock, flags);
+}
+
+static inline struct zone *zone_of(uint64_t pfn)
+{
+    if (pfn < DMA_LIMIT_PFN) return &zones[ZONE_DMA];
+    if (pfn < DMA32_LIMIT_PFN) return &zones[ZONE_DMA32];
+    return &zones[ZONE_NORMAL];
+}
+
+static inline struct free_block *pfn_block(uint64_t pfn)
+{
+    return phys_to_virt(pfn << PAGE_SHIFT);
+}
+
+static void block_insert(struct zone *z, uint64_t pfn, unsigned int order)
+{
+    struct free_block *head = &z->free_list[order];
+    struct free_block *b = pfn_block(pfn);
+
+    b->next = head->next;
+    b->prev = head;
+    head->next->prev = b;
+    head->next = b;
+    set_bit(z->free_map[order], (pfn - z->start_pfn) >> order);
+    z->nonempty |= 1u << order;
+}
+
+static void block_remove(struct zone *z, uint64_t pfn, unsigned int order)
+{
+    struct free_block *head = &z->free_list[order];
+    struct free_block *b = pfn_block(pfn);
+
+    b->prev->next = b->next;
+    b->next->prev = b->prev;
+    clear_bit(z->free_map[order], (pfn - z->start_pfn) >> order);
+    if (head->next == head) z->nonempty &= ~(1u << order);
+}
+
+// Free a block and merge it with its buddies while they are free too
+static void zone_free(struct zone *z, uint64_t pfn, unsigned int order)
+{
+    z->free_pages += 1ULL << order;
+
+    while (order < PMM_MAX_ORDER - 1) {
+        uint64_t buddy = pfn ^ (1ULL << order);
+        if (buddy < z->start_pfn || buddy + (1ULL << order) > z->end_pfn) break;
+        if (!test_bit(z->free_map[order], (buddy - z->start_pfn) >> order)) break;
+
+        block_remove(z, buddy, order);
+        pfn &= ~(1ULL << order);
+        order++;
+    }
+    block_insert(z, pfn, order);
+}
+
+// Returns the first pfn of the block, 0 when the zone has none large enough
+static uint64_t zone_alloc(struct zone *z, unsigned int order)
+{
+    uint32_t avail = z->nonempty & ~((1u << order) - 1);
+    if (!avail) return 0;
+
+    unsigned int k = (unsigned int)__builtin_ctz(avail);
+    uint64_t pfn = virt_to_phys(z->free_list[k].next) >> PAGE_SHIFT;
+    block_remove(z, pfn, k);
+
+    // Hand the upper halves back while splitting down to the wanted order
+    while (k > order) {
+        k--;
+        block_insert(z, pfn + (1ULL << k), k);
+    }
+    z->free_pages -= 1ULL << order;
+    return pfn;
+}
+
+// Feed [pfn, end) of one zone to the buddy lists as aligned blocks
+static void zone_add_range(struct zone *z, uint64_t pfn, uint64_t end)
+{
+    uint64_t flags = zone_lock(z);
+    z->managed_pages += end - pfn;
+    while (pfn < end) {
+        unsigned int order = PMM_MAX_ORDER - 1;
+        while (order && ((pfn & ((1ULL << order) - 1)) || pfn + (1ULL << order) > end)) order--;
+        zone_free(z, pfn, order);
+        pfn += 1ULL << order;
+    }
+    zone_unlock(z, flags);
+}
+
+static void free_range(uint64_t pfn, uint64_t end)
+{
+    for (int i = 0; i < ZONE_COUNT && pfn < end; i++) {
+        struct zone *z = &zones[i];
+        uint64_t lo = pfn > z->start_pfn ? pfn : z->start_pfn;
+        uint64_t hi = end < z->end_pfn ? end : z->end_pfn;
+        if (lo < hi) zone_add_range(z, lo, hi);
+    }
+}
+
+// Free [start, end) minus every reserved range from index 'from' on
+static void add_free(uint64_t start, uint64_t end, int from)
+{
+    for (int i = from; i < reserved_count && start < end; i++) {
+        struct phys_range *r = &reserved[i];
+        if (r->end <= start || r->start >= end) continue;
+        if (r->start > start) add_free(start, r->start, i + 1);
+        start = r->end;
+    }
+    if (start < end) free_range(start >> PAGE_SHIFT, end >> PAGE_SHIFT);
+}
+
+static void reserve(uint64_t start, uint64_t end)
+{
+    if (reserved_count == MAX_RESERVED) {
+        printk(KERN_ERR "pmm: too many reserved ranges\n");
+        return;
+    }
+    reserved[reserved_count].start = align_down(start, PAGE_SIZE);
+    reserved[reserved_count].end = align_up(end, PAGE_SIZE);
+    reserved_count++;
+}
+
+#define for_each_mmap_entry(e) \
+    for (uint8_t *_p = mb_mmap->entries; \
+         _p + sizeof(struct multiboot2_mmap_entry) <= (uint8_t *)mb_mmap + mb_mmap->size && \
+         ((e) = (struct multiboot2_mmap_entry *)_p); \
+         _p += mb_mmap->entry_size)
+
+// Take memory for allocator metadata straight from the memory map
+static uint64_t early_alloc(uint64_t size)
+{
+    struct multiboot2_mmap_entry *e;
+
+    size = align_up(size, PAGE_SIZE);
+    for_each_mmap_entry(e) {
+        if (e->type != MB2_MMAP_AVAILABLE) continue;
+
+        uint64_t start = align_up(e->addr > LOW_MEMORY ? e->addr : LOW_MEMORY, PAGE_SIZE);
+        uint64_t end = e->addr + e->len < BOOT_MAP_SIZE ? e->addr + e->len : BOOT_MAP_SIZE;
+        end = align_down(end, PAGE_SIZE);
+
+        for (uint64_t s = start; s + size <= end;) {
+            uint64_t next = s;
+            for (int i = 0; i < reserved_count; i++) {
+                if (reserved[i].start < s + size && reserved[i].end > s && reserved[i].end > next) {
+                    next = reserved[i].end;
+                }
+            }
+            if (next == s) {
+                reserve(s, s + size);
+                return s;
+            }
+            s = next;
+        }
+    }
+    return 0;
+}
+
+static uint64_t zone_map_words(const struct zone *z, unsigned int order)
+{
+    uint64_t blocks = (z->end_pfn - z->start_pfn + (1ULL << order) - 1) >> order;
+    return (blocks + 63) / 64;
+}
+
+/*
+ * Describe zones from the memory map, reserve what the kernel is using
+ * and free the rest of the memory reachable through the boot mapping.
+ * RAM above 4 GiB is added by pmm_add_memory() once it is mapped.
+ */
+void pmm_init(void)
+{
+    struct multiboot2_mmap_entry *e;
+
+    if (!mb_mmap) {
+        printk(KERN_ERR "pmm: no memory map from the boot loader\n");
+        return;
+    }
+
+    for_each_mmap_entry(e) {
+        if (e->type != MB2_MMAP_AVAILABLE) continue;
+        uint64_t end = (e->addr + e->len) >> PAGE_SHIFT;
+        if (end > max_pfn) max_pfn = end;
+    }
+
+    zones[ZONE_DMA].start_pfn = 0;
+    zones[ZONE_DMA].end_pfn = max_pfn < DMA_LIMIT_PFN ? max_pfn : DMA_LIMIT_PFN;
+    zones[ZONE_DMA32].start_pfn = DMA_LIMIT_PFN;
+    zones[ZONE_DMA32].end_pfn = max_pfn < DMA32_LIMIT_PFN ? max_pfn : DMA32_LIMIT_PFN;
+    zones[ZONE_NORMAL].start_pfn = DMA32_LIMIT_PFN;
+    zones[ZONE_NORMAL].end_pfn = max_pfn;
+    for (int i = 0; i < ZONE_COUNT; i++) spin_lock_init(&zones[i].lock);
+
+    // The kernel image covers the boot page tables and stack in .bss
+    reserve(0, LOW_MEMORY);
+    reserve((uint64_t)(uintptr_t)kernel_start - KERNEL_VMA, (uint64_t)(uintptr_t)kernel_end - KERNEL_VMA);
+    reserve(virt_to_phys(mbi), virt_to_phys(mbi) + mbi->total_size);
+
+    uint64_t words = 0;
+    for (int i = 0; i < ZONE_COUNT; i++) {
+        struct zone *z = &zones[i];
+        if (z->end_pfn <= z->start_pfn) z->end_pfn = z->start_pfn;
+        for (unsigned int k = 0; k < PMM_MAX_ORDER; k++) words += zone_map_words(z, k);
+    }
+
+    uint64_t maps = early_alloc(words * sizeof(uint64_t));
+    if (!maps) {
+        printk(KERN_ERR "pmm: no room for %lu bytes of buddy bitmaps\n", words * sizeof(uint64_t));
+        return;
+    }
+    uint64_t *map = phys_to_virt(maps);
+    k_memset(map, 0, words * sizeof(uint64_t));
+
+    for (int i = 0; i < ZONE_COUNT; i++) {
+        struct zone *z = &zones[i];
+        for (unsigned int k = 0; k < PMM_MAX_ORDER; k++) {
+            z->free_list[k].next = z->free_list[k].prev = &z->free_list[k];
+            z->free_map[k] = map;
+            map += zone_map_words(z, k);
+        }
+    }
+
+    pmm_add_memory(0, BOOT_MAP_SIZE);
+}
+
+// Free all available memory-map ranges inside [lo, hi)
+void pmm_add_memory(uint64_t lo, uint64_t hi)
+{
+    struct multiboot2_mmap_entry *e;
+
+    if (!mb_mmap) return;
+
+    for_each_mmap_entry(e) {
+        if (e->type != MB2_MMAP_AVAILABLE) continue;
+
+        uint64_t start = align_up(e->addr > lo ? e->addr : lo, PAGE_SIZE);
+        uint64_t end = e->addr + e->len < hi ? e->addr + e->len : hi;
+        end = align_down(end, PAGE_SIZE);
+        if (start < end) add_free(start, end, 0);
+    }
+}
+
+static uint64_t zones_alloc(unsigned int order, int highest)
+{
+    for (int i = highest; i >= 0; i--) {
+        struct zone *z = &zones[i];
+        uint64_t flags = zone_lock(z);
+        uint64_t pfn = zone_alloc(z, order);
+        zone_unlock(z, flags);
+        if (pfn) return pfn;
+    }
+    return 0;
+}
+
+// Single pages come from the local cache with interrupts off, no lock
+static uint64_t pcp_alloc(void)
+{
+    uint64_t flags = int_save();
+    struct pcp_cache *c = &pcp[cpu_id()];
+
+    if (!c->count) {
+        for (int i = ZONE_NORMAL; i >= 0 && !c->count; i--) {
+            struct zone *z = &zones[i];
+            uint64_t zflags = zone_lock(z);
+            while (c->count < PCP_BATCH) {
+                uint64_t pfn = zone_alloc(z, 0);
+                if (!pfn) break;
+                c->pfns[c->count++] = pfn;
+            }
+            zone_unlock(z, zflags);
+        }
+    }
+
+    uint64_t pfn = c->count ? c->pfns[--c->count] : 0;
+    int_restore(flags);
+    return pfn;
+}
+
+static void pcp_free(uint64_t pfn)
+{
+    uint64_t flags = int_save();
+    struct pcp_cache *c = &pcp[cpu_id()];
+
+    if (c->count == PCP_HIGH) {
+        // Return the coldest pages, one lock round trip per zone
+        for (int i = 0; i < ZONE_COUNT; i++) {
+            struct zone *z = &zones[i];
+            uint64_t zflags = zone_lock(z);
+            for (int j = 0; j < PCP_BATCH; j++) {
+                if (zone_of(c->pfns[j]) == z) zone_free(z, c->pfns[j], 0);
+            }
+            zone_unlock(z, zflags);
+        }
+        c->count -= PCP_BATCH;
+        k_memmove(c->pfns, c->pfns + PCP_BATCH, c->count * sizeof(c->pfns[0]));
+    }
+
+    c->pfns[c->count++] = pfn;
+    int_restore(flags);
+}
+
+uint64_t pmm_alloc_pages(unsigned int order, unsigned int flags)
+{
+    if (order >= PMM_MAX_ORDER) return 0;
+
+    uint64_t pfn;
+    if (flags & PMM_DMA) {
+        pfn = zones_alloc(order, ZONE_DMA);
+    } else if (flags & PMM_DMA32) {
+        pfn = zones_alloc(order, ZONE_DMA32);
+    } else if (order == 0) {
+        pfn = pcp_alloc();
+    } else {
+        pfn = zones_alloc(order, ZONE_NORMAL);
+    }
+    if (!pfn) return 0;
+
+    uint64_t phys = pfn << PAGE_SHIFT;
+    if (flags & PMM_ZERO) k_memset(phys_to_virt(phys), 0, PAGE_SIZE << order);
+    return phys;
+}
+
+void pmm_free_pages(uint64_t phys, unsigned int order)
+{
+    uint64_t pfn = phys >> PAGE_SHIFT;
+    struct zone *z = zone_of(pfn);
+
+    if (!pfn || (phys & (PAGE_SIZE - 1)) || order >= PMM_MAX_ORDER || pfn >= z->end_pfn) {
+        printk(KERN_ERR "pmm: bad free of %p order %u\n", (void *)phys, order);
+        return;
+    }
+
+    if (order == 0) {
+        pcp_free(pfn);
+        return;
+    }
+
+    uint64_t flags = zone_lock(z);
+    if (test_bit(z->free_map[order], (pfn - z->start_pfn) >> order)) {
+        zone_unlock(z, flags);
+        printk(KERN_ERR "pmm: double free of %p order %u\n", (void *)phys, order);
+        return;
+    }
+    zone_free(z, pfn, order);
+    zone_unlock(z, flags);
+}
+
+uint64_t pmm_alloc_page(unsigned int flags)
+{
+    return pmm_alloc_pages(0, flags);
+}
+
+void pmm_free_page(uint64_t phys)
+{
+    pmm_free_pages(phys, 0);
+}
+
+// Whether [start, end) is covered by available memory-map ranges
+bool pmm_is_ram(uint64_t start, uint64_t end)
+{
+    struct multiboot2_mmap_entry *e;
+
+    if (!mb_mmap) return false;
+
+    while (start < end) {
+        uint64_t next = start;
+        for_each_mmap_entry(e) {
+            if (e->type == MB2_MMAP_AVAILABLE && e->addr <= start && e->addr + e->len > start) {
+                next = e->addr + e->len;
+                break;
+            }
+        }
+        if (next == start) return false;
+        start = next;
+    }
+    return true;
+}
+
+// End of the highest available RAM range
+uint64_t pmm_max_addr(void)
+{
+    return max_pfn << PAGE_SHIFT;
+}
+
+uint64_t pmm_free_count(void)
+{
+    uint64_t pages = 0;
+    for (int i = 0; i < ZONE_COUNT; i++) pages += zones[i].free_pages;
+    for (int i = 0; i < MAX_CPUS; i++) pages += pcp[i].count;
+    return pages;
+}
+
+void pmm_report(void)
+{
+    for (int i = 0; i < ZONE_COUNT; i++) {
+        struct zone *z = &zones[i];
+        if (!z->managed_pages) continue;
+
+        char orders[PMM_MAX_ORDER * 6 + 1];
+        size_t len = 0;
+        uint64_t flags = zone_lock(z);
+        for (unsigned int k = 0; k < PMM_MAX_ORDER; k++) {
+            uint64_t n = 0;
+            for (struct free_block *b = z->free_list[k].next; b != &z->free_list[k]; b = b->next) n++;
+            len += (size_t)snprintf(orders + len, sizeof(orders) - len, " %lu", n);
+        }
+        uint64_t free_pages = z->free_pages;
+        zone_unlock(z, flags);
+
+        printk("pmm: %-6s %lu of %lu KiB free, blocks by order:%s\n", z->name,
+               free_pages * (PAGE_SIZE / 1024), z->managed_pages * (PAGE_SIZE / 1024), orders);
+    }
+}
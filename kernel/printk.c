@@ -21,13 +21,53 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <boot/info.h>
+#include <kernel/cpu.h>
+#include <kernel/log.h>
 #include <kernel/printk.h>
 #include <kernel/serial.h>
+#include <kernel/sched.h>
 #include <kernel/screen.h>
+#include <kernel/time.h>
 #include <kernel/tty.h>
 #include <kernel/vsnprintf.h>
 #include <kernel/lib/string.h>
 
+#define PRINTK_BUF_SIZE 1024
+#define TAG_ROOM 40 // space reserved in front of console text for the timestamp and level tag
+
+#define BPRINTK_RECORDS   256
+#define BPRINTK_ARG_WORDS 28
+
+/*
+ * Deferred records: the producer only reserves a slot, packs the raw
+ * arguments and publishes the slot by storing its position + 1 in seq.
+ * Formatting and console output happen in bprintk_flush(), run by a
+ * low-priority thread that the first record after a drain wakes up.
+ */
+struct bprintk_record {
+    uint64_t seq;
+    uint64_t tsc;
+    const char *fmt;
+    uint32_t level;
+    uint32_t words;
+    uint64_t args[BPRINTK_ARG_WORDS];
+};
+
+typedef char _bprintk_check[(BPRINTK_RECORDS & (BPRINTK_RECORDS - 1)) == 0 ? 1 : -1];
+
+static struct bprintk_record bprintk_ring[BPRINTK_RECORDS];
+static uint64_t bprintk_head __attribute__((aligned(64))); // next slot to reserve
+static uint64_t bprintk_tail __attribute__((aligned(64))); // next slot to drain
+static uint64_t bprintk_dropped;
+static bool bprintk_draining;
+static struct thread *bprintk_thread;
+static bool bprintk_kicked;     // bprintk_thread was woken and has not drained yet
+
+static struct log_reader console_reader;
+static bool console_busy;
+static int console_loglevel = 8; // records below this level reach the console
+
 static const char *level_tag(int level)
 {
     switch (level) {
@@ -55,39 +95,98 @@ static vga_color_t level_color(int level)
     }
 }
 
+// Strip a leading "<n>" level marker, returns the level (INFO by default)
+static int parse_level(const char **format)
+{
+    int level = 6;
+    const char *p = *format;
+    if (*p == '<') {
+        p++;
+        int v = 0;
+        bool got = false;
+        while (*p >= '0' && *p <= '9') { got = true; v = v * 10 + (*p - '0'); p++; }
+        if (got && *p == '>') { level = v; p++; *format = p; }
+    }
+    return level;
+}
+
+// loglevel=<n> on the command line quietens the console; the log keeps everything
+void printk_init(void)
+{
+    char opt[8];
+
+    if (mb_cmdline_get("loglevel", opt, sizeof(opt)) && opt[0] >= '0' && opt[0] <= '8' && !opt[1]) {
+        console_loglevel = opt[0] - '0';
+    }
+}
+
+/*
+ * Records only carry the raw TSC; it becomes "[seconds.micros] " here,
+ * on the way to the console, so storing a record stays cheap.
+ */
+static size_t format_time(char *buf, size_t size, uint64_t tsc)
+{
+    uint64_t us = tsc_to_ns(tsc) / NSEC_PER_USEC;
+    return (size_t)snprintf(buf, size, "[%5lu.%06lu] ", us / 1000000, us % 1000000);
+}
+
+/*
+ * Queue every log record the console has not shown yet, then show them
+ * as one batch. A CPU that finds the console busy leaves its record to
+ * the one already flushing, so that one looks at the log again after
+ * letting go, in case a record arrived just as it finished.
+ */
+static void console_flush(void)
+{
+    static char cbuf[TAG_ROOM + PRINTK_BUF_SIZE];
+    struct log_entry e;
+
+    do {
+        if (__atomic_exchange_n(&console_busy, true, __ATOMIC_ACQUIRE)) return;
+
+        uint64_t lost = console_reader.lost;
+        while (log_read(&console_reader, &e, cbuf + TAG_ROOM, PRINTK_BUF_SIZE)) {
+            if (console_reader.lost != lost) {
+                static const char msg[] = "[WARN] console: log records lost\n";
+                lost = console_reader.lost;
+                tty_queue(msg, sizeof(msg) - 1, level_color(4), BLACK);
+            }
+            if (e.level >= console_loglevel) continue;
+
+            char stamp[TAG_ROOM];
+            const char *tag = level_tag(e.level);
+            size_t slen = format_time(stamp, sizeof(stamp), e.tsc);
+            size_t tlen = k_strlen(tag);
+            char *line = cbuf + TAG_ROOM - tlen - slen;
+            k_memcpy(line, stamp, slen);
+            k_memcpy(line + slen, tag, tlen);
+            tty_queue(line, slen + tlen + e.len, level_color(e.level), BLACK);
+        }
+        tty_flush();
+
+        __atomic_store_n(&console_busy, false, __ATOMIC_SEQ_CST);
+    } while (__atomic_load_n(&console_reader.seq, __ATOMIC_RELAXED) < log_next_seq());
+}
+
 int printk_with_level(int level, const char *format, va_list args)
 {
-    // Format into kernel buffer
-    static char kbuf[1024];
-    int len = vsnprintf(kbuf, sizeof(kbuf), format, args);
+    char kbuf[PRINTK_BUF_SIZE];    // on the stack: any CPU or handler may be printing
 
-    // Prepend tag by moving buffer content if needed
-    const char *tag = level_tag(level);
-    char finalbuf[2300];
-    k_strcpy(finalbuf, tag);
-    k_strcat(finalbuf, kbuf);
+    // Keep deferred records ahead of anything printed synchronously
+    bprintk_flush();
 
-    size_t flen = k_strlen(finalbuf);
+    int len = vsnprintf(kbuf, sizeof(kbuf), format, args);
+    log_store(level, rdtsc(), kbuf, (size_t)len);
+    console_flush();
 
-    vga_color_t color = level_color(level);
-    
-    tty_write(0, finalbuf, flen, color, BLACK);
-    return (int)flen;
+    return (int)(k_strlen(level_tag(level)) + (size_t)len);
 }
 
 int printk(const char *format, ...)
 {
     if (!format) return 0;
 
-    int level = 6; // default INFO
-    const char *p = format;
-    if (*p == '<') {
-        p++;
-        int v = 0;
-        bool got = false;
-        while (*p >= '0' && *p <= '9') { got = true; v = v * 10 + (*p - '0'); p++; }
-        if (got && *p == '>') { level = v; p++; format = p; }
-    }
+    int level = parse_level(&format);
 
     va_list args;
     va_start(args, format);
@@ -95,3 +194,110 @@ int printk(const char *format, ...)
     va_end(args);
     return res;
 }
+
+int bprintk(const char *format, ...)
+{
+    if (!format) return -1;
+
+    int level = parse_level(&format);
+
+    // Reserve a slot, unless the drainer has fallen a full ring behind
+    uint64_t pos = __atomic_load_n(&bprintk_head, __ATOMIC_RELAXED);
+    do {
+        if (pos - __atomic_load_n(&bprintk_tail, __ATOMIC_ACQUIRE) >= BPRINTK_RECORDS) {
+            __atomic_fetch_add(&bprintk_dropped, 1, __ATOMIC_RELAXED);
+            return -1;
+        }
+    } while (!__atomic_compare_exchange_n(&bprintk_head, &pos, pos + 1, true,
+                                          __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+    struct bprintk_record *rec = &bprintk_ring[pos & (BPRINTK_RECORDS - 1)];
+    rec->tsc = rdtsc();
+    rec->fmt = format;
+    rec->level = (uint32_t)level;
+
+    va_list args;
+    va_start(args, format);
+    rec->words = (uint32_t)vbin_printf(rec->args, BPRINTK_ARG_WORDS, format, args);
+    va_end(args);
+
+    __atomic_store_n(&rec->seq, pos + 1, __ATOMIC_RELEASE);
+
+    struct thread *t = __atomic_load_n(&bprintk_thread, __ATOMIC_ACQUIRE);
+    if (t && !__atomic_exchange_n(&bprintk_kicked, true, __ATOMIC_SEQ_CST)) thread_wake(t);
+    return 0;
+}
+
+// Something for bprintk_flush() to do; only reads, so anyone may ask
+static bool bprintk_pending(void)
+{
+    uint64_t tail = __atomic_load_n(&bprintk_tail, __ATOMIC_ACQUIRE);
+    struct bprintk_record *rec = &bprintk_ring[tail & (BPRINTK_RECORDS - 1)];
+    return __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) == tail + 1 ||
+           __atomic_load_n(&bprintk_dropped, __ATOMIC_RELAXED);
+}
+
+/*
+ * Whoever finds the records already being drained leaves them to that
+ * CPU, which looks again after letting go in case one was published
+ * just as it finished.
+ */
+void bprintk_flush(void)
+{
+    static char bbuf[PRINTK_BUF_SIZE];
+
+    do {
+        if (__atomic_exchange_n(&bprintk_draining, true, __ATOMIC_ACQUIRE)) return;
+
+        bool stored = false;
+        for (;;) {
+            uint64_t tail = bprintk_tail;
+            struct bprintk_record *rec = &bprintk_ring[tail & (BPRINTK_RECORDS - 1)];
+            if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != tail + 1) break;
+
+            int len = bstr_printf(bbuf, sizeof(bbuf), rec->fmt, rec->args, rec->words);
+            log_store((int)rec->level, rec->tsc, bbuf, (size_t)len);
+            stored = true;
+
+            // The slot may be reused as soon as tail moves past it
+            __atomic_store_n(&bprintk_tail, tail + 1, __ATOMIC_RELEASE);
+        }
+
+        uint64_t dropped = __atomic_exchange_n(&bprintk_dropped, 0, __ATOMIC_RELAXED);
+        if (dropped) {
+            int len = bstr_printf(bbuf, sizeof(bbuf), "bprintk: %lu records dropped\n", &dropped, 1);
+            log_store(4, rdtsc(), bbuf, (size_t)len);
+            stored = true;
+        }
+
+        __atomic_store_n(&bprintk_draining, false, __ATOMIC_SEQ_CST);
+
+        if (stored) console_flush();
+    } while (bprintk_pending());
+}
+
+/*
+ * Clearing bprintk_kicked before draining means a record published
+ * after this pass wakes the thread again, and one published before it
+ * is seen by the pass; a wake while running is kept by thread_block().
+ */
+static void bprintk_thread_fn(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        __atomic_store_n(&bprintk_kicked, false, __ATOMIC_SEQ_CST);
+        bprintk_flush();
+        thread_block();
+    }
+}
+
+// Start draining bprintk records on their own; needs the scheduler
+void bprintk_init(void)
+{
+    struct thread *t = thread_create("bprintk", bprintk_thread_fn, NULL, PRIO_DEBUG, 0);
+    if (!t) {
+        printk(KERN_ERR "bprintk: drain thread failed, records wait for the next printk\n");
+        return;
+    }
+    __atomic_store_n(&bprintk_thread, t, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ * 
+ * This file is part of Solum OS
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <kernel/lib/ring.h>
+#include <kernel/lib/string.h>
+
+// buf goes in last, so anyone who sees it set also sees a usable ring
+void ring_init(struct ring *r, void *buf, size_t size)
+{
+    r->size = size;
+    r->head = 0;
+    r->tail = 0;
+    __atomic_store_n(&r->buf, (char *)buf, __ATOMIC_RELEASE);
+}
+
+void ring_write_at(struct ring *r, size_t pos, const void *src, size_t len)
+{
+    size_t first = ring_span_at(r, pos, len);
+    k_memcpy(ring_ptr(r, pos), src, first);
+    k_memcpy(r->buf, (const char *)src + first, len - first);
+}
+
+void ring_read_at(const struct ring *r, size_t pos, void *dest, size_t len)
+{
+    size_t first = ring_span_at(r, pos, len);
+    k_memcpy(dest, ring_ptr(r, pos), first);
+    k_memcpy((char *)dest + first, r->buf, len - first);
+}
+
+size_t ring_push(struct ring *r, const void *src, size_t len)
+{
+    size_t space = ring_space(r);
+    if (len > space) len = space;
+    ring_write_at(r, r->head, src, len);
+    __atomic_store_n(&r->head, r->head + len, __ATOMIC_RELEASE);
+    return len;
+}
+
+// Free space starting at head, up to the end of buf
+size_t ring_write_span(const struct ring *r, char **span)
+{
+    *span = ring_ptr(r, r->head);
+    return ring_span_at(r, r->head, ring_space(r));
+}
+
+void ring_produce(struct ring *r, size_t len)
+{
+    __atomic_store_n(&r->head, r->head + len, __ATOMIC_RELEASE);
+}
+
+size_t ring_peek(const struct ring *r, void *dest, size_t len)
+{
+    size_t used = ring_used(r);
+    if (len > used) len = used;
+    ring_read_at(r, r->tail, dest, len);
+    return len;
+}
+
+size_t ring_pop(struct ring *r, void *dest, size_t len)
+{
+    len = ring_peek(r, dest, len);
+    ring_consume(r, len);
+    return len;
+}
+
+// Queued bytes starting at tail, up to the end of buf; nothing is copied
+size_t ring_read_span(const struct ring *r, const char **span)
+{
+    *span = ring_ptr(r, r->tail);
+    return ring_span_at(r, r->tail, ring_used(r));
+}
+
+void ring_consume(struct ring *r, size_t len)
+{
+    __atomic_store_n(&r->tail, r->tail + len, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,499 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <kernel/apic.h>
+#include <kernel/cpu.h>
+#include <kernel/fpu.h>
+#include <kernel/hrtimer.h>
+#include <kernel/idt.h>
+#include <kernel/lib/string.h>
+#include <kernel/paging.h>
+#include <kernel/percpu.h>
+#include <kernel/pmm.h>
+#include <kernel/preempt.h>
+#include <kernel/printk.h>
+#include <kernel/sched.h>
+#include <kernel/slab.h>
+#include <kernel/smp.h>
+#include <kernel/spinlock.h>
+#include <kernel/time.h>
+
+#define THREAD_STACK_ORDER 2    // 16 KiB
+#define PRIO_IDLE          PRIO_LEVELS
+
+#define RFLAGS_IF          (1 << 9)
+
+/*
+ * One per CPU. Ready threads wait in a FIFO per urgency level, and a
+ * bit per non-empty level finds the most urgent one with a bsf. The
+ * lock is held across the switch itself and dropped by whichever
+ * thread runs next, so a thread is never visible to other CPUs before
+ * its registers are saved.
+ */
+struct runqueue {
+    spinlock_t lock;
+    struct thread *head[PRIO_LEVELS];
+    struct thread *tail[PRIO_LEVELS];
+    uint32_t ready_mask;
+    unsigned int nr_ready;
+    unsigned int nr_movable;    // ready and not pinned, what idle CPUs may take
+    struct thread *idle;
+    struct thread *dead;        // freed by the next thread to run here
+    struct hrtimer tick;        // time slice, only armed while a thread runs
+    uint64_t switches;
+    uint64_t steals;
+};
+
+DEFINE_PER_CPU(unsigned int, preempt_count);
+DEFINE_PER_CPU(bool, need_resched);
+static DEFINE_PER_CPU(struct thread *, current_thread);
+static DEFINE_PER_CPU(struct runqueue, runqueues);
+
+static uint64_t idle_cpus;      // bit per CPU running its idle thread
+static bool sched_ready;
+
+// switch.s
+void switch_to(uint64_t *prev_rsp, uint64_t next_rsp);
+void thread_start(void);
+void thread_entry(thread_fn_t fn, void *arg);
+
+static void enqueue(struct runqueue *rq, struct thread *t)
+{
+    t->next = NULL;
+    if (rq->tail[t->prio]) rq->tail[t->prio]->next = t;
+    else rq->head[t->prio] = t;
+    rq->tail[t->prio] = t;
+    rq->ready_mask |= 1U << t->prio;
+    rq->nr_ready++;
+    if (!(t->flags & THREAD_PINNED)) rq->nr_movable++;
+}
+
+// The most urgent ready thread, or with movable the most urgent unpinned one
+static struct thread *dequeue(struct runqueue *rq, bool movable)
+{
+    for (uint32_t mask = rq->ready_mask; mask; mask &= mask - 1) {
+        unsigned int prio = __builtin_ctz(mask);
+        struct thread *prev = NULL, *t = rq->head[prio];
+        while (t && movable && (t->flags & THREAD_PINNED)) {
+            prev = t;
+            t = t->next;
+        }
+        if (!t) continue;
+
+        if (prev) prev->next = t->next;
+        else rq->head[prio] = t->next;
+        if (rq->tail[prio] == t) rq->tail[prio] = prev;
+        if (!rq->head[prio]) rq->ready_mask &= ~(1U << prio);
+        rq->nr_ready--;
+        if (!(t->flags & THREAD_PINNED)) rq->nr_movable--;
+        t->next = NULL;
+        return t;
+    }
+    return NULL;
+}
+
+// Interrupts off and this CPU's queue locked; undone by finish_switch()
+static struct runqueue *rq_lock_this(uint64_t *flags)
+{
+    *flags = int_save();
+    struct runqueue *rq = this_cpu_ptr(runqueues);
+    spin_lock(&rq->lock);
+    return rq;
+}
+
+static void resched_cpu(unsigned int cpu)
+{
+    if (cpu == cpu_id()) this_cpu_write(need_resched, true);
+    else lapic_send_vector(*per_cpu_ptr(cpu_apic_id, cpu), RESCHED_VECTOR);
+}
+
+// Wake one idle CPU other than cpu so that it comes to steal
+static void kick_idle(unsigned int cpu)
+{
+    uint64_t idle = __atomic_load_n(&idle_cpus, __ATOMIC_RELAXED) & ~(1UL << cpu);
+    if (idle) resched_cpu(__builtin_ctzll(idle));
+}
+
+// t was just queued on cpu's run queue, which is locked
+static void kick(struct runqueue *rq, unsigned int cpu, struct thread *t)
+{
+    struct thread *curr = *per_cpu_ptr(current_thread, cpu);
+    if (curr == rq->idle || t->prio < curr->prio) {
+        resched_cpu(cpu);
+    } else if (!(t->flags & THREAD_PINNED)) {
+        kick_idle(cpu);
+    }
+}
+
+/*
+ * Take a thread from the CPU with the most movable ones. Only tries
+ * its lock: two CPUs stealing from each other must not deadlock, and
+ * an idle CPU that misses once is kicked or ticks again soon enough.
+ */
+static struct thread *steal(struct runqueue *rq, unsigned int cpu)
+{
+    struct runqueue *victim = NULL;
+    unsigned int most = 0;
+    for (unsigned int i = 0; i < nr_cpus; i++) {
+        struct runqueue *other = per_cpu_ptr(runqueues, i);
+        unsigned int n = __atomic_load_n(&other->nr_movable, __ATOMIC_RELAXED);
+        if (i != cpu && n > most) {
+            most = n;
+            victim = other;
+        }
+    }
+    if (!victim || !spin_trylock(&victim->lock)) return NULL;
+
+    struct thread *t = dequeue(victim, true);
+    if (t) {
+        t->cpu = cpu;   // before the unlock, for thread_wake()
+        rq->steals++;
+    }
+    spin_unlock(&victim->lock);
+    return t;
+}
+
+static void thread_free(struct thread *t)
+{
+    if (t->stack) pmm_free_pages(virt_to_phys(t->stack), THREAD_STACK_ORDER);
+    kfree(t->fpu_alloc);
+    kfree(t);
+}
+
+static void finish_switch(struct runqueue *rq, uint64_t flags)
+{
+    struct thread *dead = rq->dead;
+    rq->dead = NULL;
+    spin_unlock_irqrestore(&rq->lock, flags);
+    if (dead) thread_free(dead);
+}
+
+static void schedule_locked(struct runqueue *rq, uint64_t flags)
+{
+    struct thread *prev = this_cpu_read(current_thread);
+    unsigned int cpu = cpu_id();
+    this_cpu_write(need_resched, false);
+
+    if (prev->state == THREAD_RUNNING && prev != rq->idle) {
+        prev->state = THREAD_READY;
+        enqueue(rq, prev);
+    }
+    struct thread *next = dequeue(rq, false);
+    if (!next) next = steal(rq, cpu);
+    if (!next) next = rq->idle;
+    next->state = THREAD_RUNNING;
+    next->cpu = cpu;
+
+    if (next != prev) {
+        if (next == rq->idle) {
+            __atomic_fetch_or(&idle_cpus, 1UL << cpu, __ATOMIC_RELAXED);
+        } else {
+            if (prev == rq->idle) __atomic_fetch_and(&idle_cpus, ~(1UL << cpu), __ATOMIC_RELAXED);
+            if (!hrtimer_active(&rq->tick)) hrtimer_start(&rq->tick, ktime_get_ns() + SCHED_SLICE_NS);
+            if (rq->nr_movable) kick_idle(cpu);
+        }
+        rq->switches++;
+
+        this_cpu_write(current_thread, next);
+        fpu_switch(prev, next);
+        switch_to(&prev->rsp, next->rsp);
+
+        // Back in prev, possibly on another CPU
+        rq = this_cpu_ptr(runqueues);
+    }
+    finish_switch(rq, flags);
+}
+
+// Run the most urgent ready thread, which may be the caller
+void schedule(void)
+{
+    uint64_t flags;
+    struct runqueue *rq = rq_lock_this(&flags);
+    schedule_locked(rq, flags);
+}
+
+// From preempt_enable()
+void preempt_schedule(void)
+{
+    if (!int_enabled() || !this_cpu_read(current_thread)) return;
+    schedule();
+}
+
+// On the way out of an interrupt that arrived with interrupts on
+void sched_preempt_irq(void)
+{
+    if (this_cpu_read(need_resched) && !this_cpu_read(preempt_count) &&
+        this_cpu_read(current_thread)) {
+        schedule();
+    }
+}
+
+// Where a new thread's first switch_to() lands, via thread_start
+void thread_entry(thread_fn_t fn, void *arg)
+{
+    finish_switch(this_cpu_ptr(runqueues), RFLAGS_IF);
+    fn(arg);
+    thread_exit();
+}
+
+static struct thread *thread_alloc(const char *name, unsigned int prio, unsigned int flags)
+{
+    struct thread *t = kzalloc(sizeof(*t));
+    if (!t) return NULL;
+    t->fpu_alloc = kzalloc(fpu_state_size() + 63);
+    if (!t->fpu_alloc) {
+        kfree(t);
+        return NULL;
+    }
+    t->fpu = (void *)(((uintptr_t)t->fpu_alloc + 63) & ~(uintptr_t)63);
+    t->prio = prio;
+    t->flags = flags;
+    t->cpu = cpu_id();
+    k_strncpy(t->name, name, sizeof(t->name) - 1);
+    return t;
+}
+
+/*
+ * A stack that switch_to() can return into: the callee-saved registers
+ * it pops, with fn and arg in r12 and r13, then thread_start, placed so
+ * that thread_entry() is called on a 16-byte aligned stack.
+ */
+static bool thread_stack(struct thread *t, thread_fn_t fn, void *arg)
+{
+    uint64_t phys = pmm_alloc_pages(THREAD_STACK_ORDER, 0);
+    if (!phys) return false;
+
+    t->stack = phys_to_virt(phys);
+    uint64_t *sp = (uint64_t *)((uint8_t *)t->stack + (PAGE_SIZE << THREAD_STACK_ORDER));
+    *--sp = 0;
+    *--sp = 0;
+    *--sp = (uint64_t)(uintptr_t)thread_start;
+    *--sp = 0;                          // rbp
+    *--sp = 0;                          // rbx
+    *--sp = (uint64_t)(uintptr_t)fn;    // r12
+    *--sp = (uint64_t)(uintptr_t)arg;   // r13
+    *--sp = 0;                          // r14
+    *--sp = 0;                          // r15
+    t->rsp = (uint64_t)(uintptr_t)sp;
+    return true;
+}
+
+/*
+ * Queue a new thread on this CPU at urgency prio (PRIO_*). It runs at
+ * once when more urgent than the caller. The pointer stays valid until
+ * fn returns or calls thread_exit().
+ */
+struct thread *thread_create(const char *name, thread_fn_t fn, void *arg, unsigned int prio, unsigned int flags)
+{
+    if (!this_cpu_read(current_thread)) return NULL;
+    if (prio >= PRIO_LEVELS) prio = PRIO_LEVELS - 1;
+
+    struct thread *t = thread_alloc(name, prio, flags);
+    if (!t) return NULL;
+    if (!thread_stack(t, fn, arg)) {
+        thread_free(t);
+        return NULL;
+    }
+
+    uint64_t irq;
+    struct runqueue *rq = rq_lock_this(&irq);
+    t->cpu = cpu_id();
+    t->state = THREAD_READY;
+    enqueue(rq, t);
+    kick(rq, t->cpu, t);
+    spin_unlock_irqrestore(&rq->lock, irq);
+    return t;
+}
+
+struct thread *thread_current(void)
+{
+    return this_cpu_read(current_thread);
+}
+
+// Let other threads of the same urgency run
+void thread_yield(void)
+{
+    schedule();
+}
+
+// Sleep until thread_wake(); returns at once if a wakeup came first
+void thread_block(void)
+{
+    uint64_t flags;
+    struct runqueue *rq = rq_lock_this(&flags);
+    struct thread *t = this_cpu_read(current_thread);
+    if (t->wake_pending) {
+        t->wake_pending = false;
+        spin_unlock_irqrestore(&rq->lock, flags);
+        return;
+    }
+    t->state = THREAD_BLOCKED;
+    schedule_locked(rq, flags);
+}
+
+/*
+ * Make t ready on the CPU it last ran on, where its cache is warm, and
+ * get that CPU (or an idle one) to look at it. Safe from interrupt
+ * handlers. t must not have exited.
+ */
+void thread_wake(struct thread *t)
+{
+    struct runqueue *rq;
+    uint64_t flags;
+    unsigned int cpu;
+    for (;;) {
+        cpu = __atomic_load_n(&t->cpu, __ATOMIC_RELAXED);
+        rq = per_cpu_ptr(runqueues, cpu);
+        flags = spin_lock_irqsave(&rq->lock);
+        if (t->cpu == cpu) break;
+        spin_unlock_irqrestore(&rq->lock, flags);   // stolen meanwhile
+    }
+
+    if (t->state == THREAD_BLOCKED) {
+        t->state = THREAD_READY;
+        enqueue(rq, t);
+        kick(rq, cpu, t);
+    } else if (t->state != THREAD_DEAD) {
+        t->wake_pending = true;
+    }
+    spin_unlock_irqrestore(&rq->lock, flags);
+}
+
+void thread_exit(void)
+{
+    uint64_t flags;
+    struct runqueue *rq = rq_lock_this(&flags);
+    struct thread *t = this_cpu_read(current_thread);
+    t->state = THREAD_DEAD;
+    rq->dead = t;
+    schedule_locked(rq, flags);
+    __builtin_unreachable();
+}
+
+// Round robin among equals; only runs while a thread other than idle does
+static void tick_fn(struct hrtimer *timer)
+{
+    struct runqueue *rq = this_cpu_ptr(runqueues);
+    if (this_cpu_read(current_thread) == rq->idle) return;
+
+    if (__atomic_load_n(&rq->nr_ready, __ATOMIC_RELAXED)) this_cpu_write(need_resched, true);
+    hrtimer_start(timer, ktime_get_ns() + SCHED_SLICE_NS);
+}
+
+static void resched_ipi(struct int_frame *frame)
+{
+    (void)frame;
+    this_cpu_write(need_resched, true);
+    lapic_eoi();
+}
+
+static bool work_available(struct runqueue *rq)
+{
+    if (__atomic_load_n(&rq->nr_ready, __ATOMIC_RELAXED)) return true;
+    for (unsigned int i = 0; i < nr_cpus; i++) {
+        if (per_cpu_ptr(runqueues, i) != rq &&
+            __atomic_load_n(&per_cpu_ptr(runqueues, i)->nr_movable, __ATOMIC_RELAXED)) return true;
+    }
+    return false;
+}
+
+/*
+ * The idle thread: halt until an interrupt, typically a resched IPI
+ * or the end of a sleep, and look for work, stealing it if need be.
+ */
+void sched_idle(void)
+{
+    struct runqueue *rq = this_cpu_ptr(runqueues);
+    for (;;) {
+        if (rq->idle && work_available(rq)) schedule();
+        else cpu_halt();
+    }
+}
+
+static void idle_fn(void *arg)
+{
+    (void)arg;
+    sched_idle();
+}
+
+static void rq_init(struct runqueue *rq)
+{
+    spin_lock_init(&rq->lock);
+    hrtimer_setup(&rq->tick, tick_fn);
+}
+
+// The code already running on this CPU becomes a thread
+static struct thread *adopt(const char *name, unsigned int prio)
+{
+    struct thread *t = thread_alloc(name, prio, THREAD_PINNED);
+    if (t) t->state = THREAD_RUNNING;
+    return t;
+}
+
+/*
+ * Turn the boot code into the pinned "main" thread and give the boot
+ * CPU an idle thread. Needs fpu_init(), the slab allocator and the
+ * hrtimers, and must run before smp_init() so that the other CPUs can
+ * join in.
+ */
+void sched_init(void)
+{
+    struct runqueue *rq = this_cpu_ptr(runqueues);
+    rq_init(rq);
+    struct thread *boot = adopt("main", PRIO_DEFAULT);
+    struct thread *idle = thread_alloc("idle", PRIO_IDLE, THREAD_PINNED);
+    if (!boot || !idle || !thread_stack(idle, idle_fn, NULL)) {
+        if (boot) thread_free(boot);
+        if (idle) thread_free(idle);
+        printk(KERN_ERR "sched: out of memory, no threads\n");
+        return;
+    }
+
+    int_register(RESCHED_VECTOR, resched_ipi);
+    rq->idle = idle;
+    this_cpu_write(current_thread, boot);
+    sched_ready = true;
+    printk("sched: %u urgency levels, %u ms slices\n", PRIO_LEVELS, SCHED_SLICE_NS / 1000000);
+}
+
+// On a secondary CPU, whose boot code then becomes its idle thread
+void sched_init_cpu(void)
+{
+    if (!sched_ready) return;
+
+    struct runqueue *rq = this_cpu_ptr(runqueues);
+    rq_init(rq);
+    struct thread *idle = adopt("idle", PRIO_IDLE);
+    if (!idle) return;
+
+    rq->idle = idle;
+    this_cpu_write(current_thread, idle);
+    __atomic_fetch_or(&idle_cpus, 1UL << cpu_id(), __ATOMIC_RELAXED);
+}
+
+void sched_report(void)
+{
+    for (unsigned int cpu = 0; cpu < nr_cpus; cpu++) {
+        const struct runqueue *rq = per_cpu_ptr(runqueues, cpu);
+        printk("sched: CPU %u: %lu switches, %lu threads stolen\n", cpu, rq->switches, rq->steals);
+    }
+}
@@ -22,78 +22,190 @@
 #include <stdarg.h>
 #include <stdbool.h>
 #include <kernel/screen.h>
+#include <kernel/fbcon.h>
+#include <kernel/paging.h>
 #include <kernel/lib/string.h>
 #include <kernel/port.h>
+#include <kernel/spinlock.h>
 
-#define SCREEN_WIDTH 80
-#define SCREEN_HEIGHT 25
+#define VGA_WIDTH 80
+#define VGA_HEIGHT 25
 #define TAB_LENGTH 4
 
-static uint16_t *video_memory = (uint16_t *)0xB8000;
-static uint8_t cursor_x = 0;
-static uint8_t cursor_y = 0;
+// Large enough for a 1920x1080 framebuffer with 8x16 cells
+#define SCREEN_MAX_WIDTH 240
+#define SCREEN_MAX_HEIGHT 68
+
+/*
+ * All writes go to a RAM shadow of the text screen. Row r on screen is
+ * shadow row (origin + r) % screen_height, so scrolling just moves the
+ * origin. scr_write() then pushes the columns it dirtied to VGA text
+ * memory or to the framebuffer console, and sets the cursor once.
+ */
+static volatile uint64_t *video_memory = (volatile uint64_t *)(PAGE_OFFSET + 0xB8000);
+static uint16_t shadow[SCREEN_MAX_HEIGHT][SCREEN_MAX_WIDTH] __attribute__((aligned(8)));
+static size_t screen_width = VGA_WIDTH;
+static size_t screen_height = VGA_HEIGHT;
+static bool use_fbcon = false;
+
+// Cursor, shadow buffer and hardware state
+static DEFINE_SPINLOCK(screen_lock);
+
+static size_t origin = 0;
+static size_t scrolled = 0;                 // lines scrolled since the last flush
+static uint16_t dirty_lo[SCREEN_MAX_HEIGHT]; // per shadow row: dirty columns [lo, hi)
+static uint16_t dirty_hi[SCREEN_MAX_HEIGHT];
+static size_t cursor_x = 0;
+static size_t cursor_y = 0;
+static uint16_t hw_cursor = 0xFFFF;
+
+#define VGA_ROW_WORDS (VGA_WIDTH * sizeof(uint16_t) / sizeof(uint64_t))
+
+typedef char _screen_check[(VGA_WIDTH * sizeof(uint16_t)) % sizeof(uint64_t) == 0 ? 1 : -1];
+
+static inline size_t shadow_index(size_t y)
+{
+    size_t r = origin + y;
+    return r >= screen_height ? r - screen_height : r;
+}
+
+static inline void mark_dirty(size_t r, size_t x0, size_t x1)
+{
+    if (dirty_lo[r] >= dirty_hi[r]) {
+        dirty_lo[r] = (uint16_t)x0;
+        dirty_hi[r] = (uint16_t)x1;
+        return;
+    }
+    if (x0 < dirty_lo[r]) dirty_lo[r] = (uint16_t)x0;
+    if (x1 > dirty_hi[r]) dirty_hi[r] = (uint16_t)x1;
+}
 
 static void move_cursor(void)
 {
-    uint16_t cursor_location = cursor_y * SCREEN_WIDTH + cursor_x;
+    if (use_fbcon) return;
+
+    uint16_t cursor_location = cursor_y * VGA_WIDTH + cursor_x;
+    if (cursor_location == hw_cursor) return;
+    hw_cursor = cursor_location;
+
     outb(0x3D4, 14);
     outb(0x3D5, cursor_location >> 8);
     outb(0x3D4, 15);
     outb(0x3D5, cursor_location & 0xFF);
 }
 
-void clear_screen(void)
+// Copy whole dirty rows to VRAM, 8 bytes per store
+static void vga_flush(void)
+{
+    for (size_t y = 0; y < screen_height; y++) {
+        size_t r = shadow_index(y);
+        if (!scrolled && dirty_lo[r] >= dirty_hi[r]) continue;
+        dirty_lo[r] = dirty_hi[r] = 0;
+
+        const uint64_t *src = (const uint64_t *)shadow[r];
+        volatile uint64_t *dst = video_memory + y * VGA_ROW_WORDS;
+        for (size_t i = 0; i < VGA_ROW_WORDS; i++) {
+            dst[i] = src[i];
+        }
+    }
+}
+
+// Shift the pixels for the scrolled lines, then render only dirty cells
+static void fb_flush(void)
+{
+    if (scrolled >= screen_height) {
+        for (size_t r = 0; r < screen_height; r++) mark_dirty(r, 0, screen_width);
+    } else if (scrolled) {
+        fbcon_scroll(scrolled);
+    }
+
+    for (size_t y = 0; y < screen_height; y++) {
+        size_t r = shadow_index(y);
+        if (dirty_lo[r] >= dirty_hi[r]) continue;
+        fbcon_draw(y, dirty_lo[r], dirty_hi[r], shadow[r]);
+        dirty_lo[r] = dirty_hi[r] = 0;
+    }
+    fbcon_flush();
+}
+
+static void screen_flush(void)
+{
+    if (use_fbcon) {
+        fb_flush();
+    } else {
+        vga_flush();
+    }
+    scrolled = 0;
+}
+
+static void clear_locked(void)
 {
     cursor_x = 0;
     cursor_y = 0;
-    
+    origin = 0;
+
     const uint16_t blank = ' ' | (0 << 8);
-    for (size_t i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; i++) {
-        video_memory[i] = blank;
+    for (size_t j = 0; j < screen_height; j++) {
+        for (size_t i = 0; i < screen_width; i++) {
+            shadow[j][i] = blank;
+        }
+        mark_dirty(j, 0, screen_width);
     }
+    screen_flush();
     move_cursor();
 }
 
-void screen_scroll_once(void)
+void clear_screen(void)
 {
-    for (size_t j = 0; j < SCREEN_HEIGHT - 1; j++) {
-        for (size_t i = 0; i < SCREEN_WIDTH; i++) {
-            video_memory[j * SCREEN_WIDTH + i] = video_memory[(j + 1) * SCREEN_WIDTH + i];
-        }
-    }
-    
+    uint64_t flags = spin_lock_irqsave(&screen_lock);
+    clear_locked();
+    spin_unlock_irqrestore(&screen_lock, flags);
+}
+
+static void scroll_once(void)
+{
+    // The old top row becomes the new bottom row
+    size_t last = origin;
+    origin = (origin + 1 == screen_height) ? 0 : origin + 1;
+
     const uint16_t blank = ' ' | (0 << 8);
-    for (size_t i = 0; i < SCREEN_WIDTH; i++) {
-        video_memory[(SCREEN_HEIGHT - 1) * SCREEN_WIDTH + i] = blank;
+    for (size_t i = 0; i < screen_width; i++) {
+        shadow[last][i] = blank;
     }
-    
+    mark_dirty(last, 0, screen_width);
+
+    if (scrolled < screen_height) scrolled++;
+
     if (cursor_y > 0) {
         cursor_y--;
     }
-    move_cursor();
+}
+
+static void vga_newline(void)
+{
+    cursor_x = 0;
+    cursor_y++;
+    if (cursor_y >= screen_height) {
+        scroll_once();
+        cursor_y = screen_height - 1;
+    }
 }
 
 static void vga_putc_raw(char c, int back, int fore)
 {
     if (c == '\0') c = ' '; // Replace null with space
-    
+
     uint16_t attribute = (back << 12) | (fore << 8);
-    uint16_t *location = video_memory + cursor_y * SCREEN_WIDTH + cursor_x;
-    *location = c | attribute;
-    
+    size_t r = shadow_index(cursor_y);
+    shadow[r][cursor_x] = (uint8_t)c | attribute;
+    mark_dirty(r, cursor_x, cursor_x + 1);
+
     cursor_x++;
-    if (cursor_x >= SCREEN_WIDTH) {
-        cursor_x = 0;
-        cursor_y++;
-        if (cursor_y >= SCREEN_HEIGHT) {
-            screen_scroll_once();
-            cursor_y = SCREEN_HEIGHT - 1;
-        }
+    if (cursor_x >= screen_width) {
+        vga_newline();
     }
-    move_cursor();
 }
-
-void vga_putc(char c, vga_color_t fore, vga_color_t back)
+static void vga_putc_one(char c, vga_color_t fore, vga_color_t back)
 {
     switch (c) {
         case '\t':
@@ -102,31 +214,87 @@ void vga_putc(char c, vga_color_t fore, vga_color_t back)
             }
             break;
         case '\n':
-            cursor_x = 0;
-            cursor_y++;
-            if (cursor_y >= SCREEN_HEIGHT) {
-                screen_scroll_once();
-                cursor_y = SCREEN_HEIGHT - 1;
-            }
-            move_cursor();
+            vga_newline();
             break;
         case '\r':
             cursor_x = 0;
-            move_cursor();
             break;
         default:
             vga_putc_raw(c, back, fore);
     }
 }
 
-void scr_write(const char *buf, size_t len, vga_color_t fore, vga_color_t back)
+void screen_scroll_once(void)
+{
+    uint64_t flags = spin_lock_irqsave(&screen_lock);
+    scroll_once();
+    spin_unlock_irqrestore(&screen_lock, flags);
+}
+
+void vga_putc(char c, vga_color_t fore, vga_color_t back)
+{
+    uint64_t flags = spin_lock_irqsave(&screen_lock);
+    vga_putc_one(c, fore, back);
+    screen_flush();
+    move_cursor();
+    spin_unlock_irqrestore(&screen_lock, flags);
+}
+
+void scr_write_runs(const struct scr_run *runs, size_t n)
 {
-    for (size_t i = 0; i < len; i++) {
-        vga_putc(buf[i], fore, back);
+    uint64_t flags = spin_lock_irqsave(&screen_lock);
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < runs[i].len; j++) {
+            vga_putc_one(runs[i].text[j], runs[i].fore, runs[i].back);
+        }
     }
+    screen_flush();
+    move_cursor();
+    spin_unlock_irqrestore(&screen_lock, flags);
+}
+
+void scr_write(const char *buf, size_t len, vga_color_t fore, vga_color_t back)
+{
+    struct scr_run run = { buf, len, fore, back };
+    scr_write_runs(&run, 1);
+}
+
+/*
+ * Move the framebuffer console to a write-combining mapping. ioremap()
+ * interrupts every CPU, so the mapping is built before taking the lock.
+ */
+bool scr_remap(void)
+{
+    if (!use_fbcon) return false;
+
+    void *wc = fbcon_map_wc();
+    if (!wc) return false;
+
+    uint64_t flags = spin_lock_irqsave(&screen_lock);
+    fbcon_set_mapping(wc);
+    spin_unlock_irqrestore(&screen_lock, flags);
+    return true;
+}
+
+// Copy the whole framebuffer console image again; returns the bytes written
+size_t scr_refresh(void)
+{
+    if (!use_fbcon) return 0;
+
+    uint64_t flags = spin_lock_irqsave(&screen_lock);
+    size_t bytes = fbcon_refresh();
+    spin_unlock_irqrestore(&screen_lock, flags);
+    return bytes;
 }
 
 void scr_init(void)
 {
+    size_t cols, rows;
+
+    if (fbcon_init(&cols, &rows)) {
+        use_fbcon = true;
+        screen_width = cols < SCREEN_MAX_WIDTH ? cols : SCREEN_MAX_WIDTH;
+        screen_height = rows < SCREEN_MAX_HEIGHT ? rows : SCREEN_MAX_HEIGHT;
+    }
     clear_screen();
 }
\ No newline at end of file
@@ -23,44 +23,266 @@
 #include <stdbool.h>
 #include <kernel/serial.h>
 #include <kernel/port.h>
+#include <kernel/idt.h>
+#include <kernel/irq.h>
+#include <kernel/spinlock.h>
+#include <boot/info.h>
+#include <kernel/lib/ring.h>
 #include <kernel/lib/string.h>
+#include <kernel/vsnprintf.h>
 
-#define SERIAL_PORT 0x3F8
+#define UART_CLOCK_BAUD 115200  // 1.8432 MHz / 16, the rate at divisor 1
+#define UART_DEFAULT_BAUD 38400
+#define UART_MIN_BAUD 2         // slowest rate whose divisor fits in 16 bits
+
+#define UART_IER_THRE 0x02  // transmitter holding register empty interrupt
+#define UART_FIFO_SIZE 16
+
+#define SRL_TX_SIZE 8192
+
+/*
+ * Transmit ring: srl_write() is the only producer and pushes without a
+ * lock. There are two consumers, the THRE interrupt and the polled drain
+ * a CPU with interrupts off falls back to, so srl_tx_lock serialises them
+ * along with every read-modify-write of the IER copy.
+ */
+static char srl_tx_buf[SRL_TX_SIZE];
+static struct ring srl_tx = RING_INIT(srl_tx_buf);
+static bool srl_irq_mode = false;
+static uint8_t srl_ier = 0;
+static DEFINE_SPINLOCK(srl_tx_lock);
+
+// Selected with console=ttyS<n>[,baud], ttyS0 at 38400 otherwise
+static uint16_t srl_port = 0x3F8;
+static uint8_t srl_irq_line = 4;
+static int srl_fifo_size = 1; // bytes we may write per THRE check
+
+// Colour the terminal is showing; light grey on black is its default
+static vga_color_t srl_fore = LIGHT_GREY;
+static vga_color_t srl_back = BLACK;
+
+static const struct {
+    uint16_t port;
+    uint8_t irq;
+} srl_ports[] = {
+    { 0x3F8, 4 }, { 0x2F8, 3 }, { 0x3E8, 4 }, { 0x2E8, 3 },
+};
+
+typedef char _srl_check[(SRL_TX_SIZE & (SRL_TX_SIZE - 1)) == 0 ? 1 : -1];
 
 static bool serial_is_transmit_empty(void)
 {
-    return inb(SERIAL_PORT + 5) & 0x20;
+    return inb(srl_port + 5) & 0x20;
 }
 
 static bool serial_is_receive_ready(void)
 {
-    return inb(SERIAL_PORT + 5) & 0x01;
+    return inb(srl_port + 5) & 0x01;
+}
+
+static uint32_t parse_uint(const char *s)
+{
+    uint32_t v = 0;
+    while (*s >= '0' && *s <= '9') v = v * 10 + (uint32_t)(*s++ - '0');
+    return v;
+}
+
+// console=ttyS<n>[,<baud>]; anything else keeps the defaults
+static uint32_t srl_parse_console(void)
+{
+    char opt[32];
+
+    if (!mb_cmdline_get("console", opt, sizeof(opt))) return UART_DEFAULT_BAUD;
+    if (k_strncmp(opt, "ttyS", 4) != 0) return UART_DEFAULT_BAUD;
+
+    uint32_t n = parse_uint(opt + 4);
+    if (n < sizeof(srl_ports) / sizeof(srl_ports[0])) {
+        srl_port = srl_ports[n].port;
+        srl_irq_line = srl_ports[n].irq;
+    }
+
+    const char *comma = k_strchr(opt, ',');
+    uint32_t baud = comma ? parse_uint(comma + 1) : 0;
+    return (baud >= UART_MIN_BAUD && baud <= UART_CLOCK_BAUD) ? baud : UART_DEFAULT_BAUD;
 }
 
 void srl_init(void)
 {
-    outb(SERIAL_PORT + 1, 0x00); // Disable all interrupts
-    outb(SERIAL_PORT + 3, 0x80); // Enable DLAB (set baud rate divisor)
-    outb(SERIAL_PORT + 0, 0x03); // Set divisor to 3 (lo byte) 38400 baud
-    outb(SERIAL_PORT + 1, 0x00); //                  (hi byte)
-    outb(SERIAL_PORT + 3, 0x03); // 8 bits, no parity, one stop bit
-    outb(SERIAL_PORT + 2, 0xC7); // Enable FIFO, clear them, with 14-byte threshold
-    outb(SERIAL_PORT + 4, 0x0B); // IRQs enabled, RTS/DSR set
+    uint32_t baud = srl_parse_console();
+    uint16_t divisor = (uint16_t)((UART_CLOCK_BAUD + baud / 2) / baud);
+
+    outb(srl_port + 1, 0x00);                   // Disable all interrupts
+    outb(srl_port + 3, 0x80);                   // Enable DLAB (set baud rate divisor)
+    outb(srl_port + 0, divisor & 0xFF);         // Divisor lo byte
+    outb(srl_port + 1, divisor >> 8);           //         hi byte
+    outb(srl_port + 3, 0x03);                   // 8 bits, no parity, one stop bit
+    outb(srl_port + 2, 0xC7);                   // Enable FIFO, clear them, with 14-byte threshold
+    outb(srl_port + 4, 0x0B);                   // IRQs enabled, RTS/DSR set
+
+    // IIR bits 7:6 read back 11 only on a 16550A with a working FIFO
+    srl_fifo_size = (inb(srl_port + 2) & 0xC0) == 0xC0 ? UART_FIFO_SIZE : 1;
 }
 
-void serial_putc(char c)
+/*
+ * Polled transmit: one LSR check frees the whole FIFO, so fill it before
+ * looking again. *room is the space known to be left from the last check.
+ */
+static inline void srl_put_polled(char c, int *room)
 {
-    while (!serial_is_transmit_empty());
-    if (c == '\n') {
+    if (*room == 0) {
         while (!serial_is_transmit_empty());
-        outb(SERIAL_PORT, '\r');
+        *room = srl_fifo_size;
     }
-    outb(SERIAL_PORT, c);
+    outb(srl_port, c);
+    (*room)--;
+}
+
+// Send queued bytes by polling; used when the ISR cannot run
+static void srl_tx_drain_polled(void)
+{
+    int room = 0;
+    const char *span;
+    size_t n;
+
+    uint64_t flags = spin_lock_irqsave(&srl_tx_lock);
+    while ((n = ring_read_span(&srl_tx, &span)) > 0) {
+        for (size_t i = 0; i < n; i++) srl_put_polled(span[i], &room);
+        ring_consume(&srl_tx, n);
+    }
+    spin_unlock_irqrestore(&srl_tx_lock, flags);
+}
+
+// Re-arming THRE while the FIFO is empty raises the interrupt right away
+static void srl_tx_kick(void)
+{
+    uint64_t flags = spin_lock_irqsave(&srl_tx_lock);
+    srl_ier |= UART_IER_THRE;
+    outb(srl_port + 1, srl_ier);
+    spin_unlock_irqrestore(&srl_tx_lock, flags);
+}
+
+static void srl_tx_push(const char *buf, size_t len)
+{
+    for (;;) {
+        size_t n = ring_push(&srl_tx, buf, len);
+        buf += n;
+        len -= n;
+        if (len == 0) return;
+
+        // Ring full: wait for the ISR to make room, or drain it ourselves
+        if (int_enabled()) {
+            srl_tx_kick();
+            asm volatile ("pause");
+        } else {
+            srl_tx_drain_polled();
+        }
+    }
+}
+
+// THR is empty: refill the whole FIFO, or stop the interrupt when idle
+static void srl_tx_fill(void)
+{
+    size_t room = (size_t)srl_fifo_size;
+    const char *span;
+    size_t n;
+
+    uint64_t flags = spin_lock_irqsave(&srl_tx_lock);
+    while (room > 0 && (n = ring_read_span(&srl_tx, &span)) > 0) {
+        if (n > room) n = room;
+        for (size_t i = 0; i < n; i++) outb(srl_port, span[i]);
+        ring_consume(&srl_tx, n);
+        room -= n;
+    }
+
+    // A producer that pushes after this check re-arms THRE once we let go
+    if (!ring_used(&srl_tx)) {
+        srl_ier &= (uint8_t)~UART_IER_THRE;
+        outb(srl_port + 1, srl_ier);
+    }
+    spin_unlock_irqrestore(&srl_tx_lock, flags);
+}
+
+static void srl_irq(struct int_frame *frame)
+{
+    (void)frame;
+    uint8_t iir;
+
+    while (!((iir = inb(srl_port + 2)) & 0x01)) {
+        switch (iir & 0x0E) {
+            case 0x02: srl_tx_fill(); break;            // THR empty
+            case 0x04: case 0x0C: inb(srl_port); break; // RX data, unused for now
+            case 0x06: inb(srl_port + 5); break;        // line status
+            default: inb(srl_port + 6); break;          // modem status
+        }
+    }
+}
+
+// VGA keeps blue in bit 0 and red in bit 2, ANSI the other way round
+static int ansi_color(vga_color_t c)
+{
+    return (c & 2) | (c & 1) << 2 | (c & 4) >> 2;
+}
+
+// SGR sequence selecting fore on back, using the bright range for VGA's upper eight
+static size_t srl_sgr(char *buf, size_t size, vga_color_t fore, vga_color_t back)
+{
+    if (fore == LIGHT_GREY && back == BLACK) return (size_t)snprintf(buf, size, "\x1b[0m");
+    return (size_t)snprintf(buf, size, "\x1b[0;%d;%dm",
+                            ((fore & 8) ? 90 : 30) + ansi_color(fore),
+                            ((back & 8) ? 100 : 40) + ansi_color(back));
+}
+
+// Switch transmit to the interrupt-driven ring (needs the IDT and irq_init())
+void srl_irq_init(void)
+{
+    irq_register(srl_irq_line, srl_irq);
+    srl_irq_mode = true;
+    irq_unmask(srl_irq_line);
 }
 
 void srl_write(const char *buf, size_t len)
 {
-    for (size_t i = 0; i < len; i++) {
-        serial_putc(buf[i]);
+    if (!srl_irq_mode) {
+        int room = 0;
+        for (size_t i = 0; i < len; i++) {
+            if (buf[i] == '\n') srl_put_polled('\r', &room);
+            srl_put_polled(buf[i], &room);
+        }
+        return;
+    }
+
+    // Whole runs between newlines go in as one copy each
+    while (len > 0) {
+        size_t run = 0;
+        while (run < len && buf[run] != '\n') run++;
+        srl_tx_push(buf, run);
+        if (run < len) {
+            srl_tx_push("\r\n", 2);
+            run++;
+        }
+        buf += run;
+        len -= run;
+    }
+
+    // With interrupts off (early boot, fault paths) nothing would send it
+    if (int_enabled()) {
+        srl_tx_kick();
+    } else {
+        srl_tx_drain_polled();
+    }
+}
+
+// Runs as written by the tty, with an escape sequence only where the colour changes
+void srl_write_runs(const struct scr_run *runs, size_t n)
+{
+    char sgr[16];
+
+    for (size_t i = 0; i < n; i++) {
+        if (runs[i].fore != srl_fore || runs[i].back != srl_back) {
+            srl_fore = runs[i].fore;
+            srl_back = runs[i].back;
+            srl_write(sgr, srl_sgr(sgr, sizeof(sgr), srl_fore, srl_back));
+        }
+        srl_write(runs[i].text, runs[i].len);
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,479 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <kernel/cpu.h>
+#include <kernel/idt.h>
+#include <kernel/paging.h>
+#include <kernel/pmm.h>
+#include <kernel/printk.h>
+#include <kernel/spinlock.h>
+#include <kernel/slab.h>
+#include <kernel/vsnprintf.h>
+#include <kernel/lib/string.h>
+
+/*
+ * Every slab is one naturally aligned 64 KiB buddy block with its header
+ * at the start, so the slab of any object is found by masking the
+ * address. Free objects form a list threaded through the objects.
+ *
+ * On top of the slabs sits a per-CPU magazine layer (Bonwick): each CPU
+ * owns a loaded and a previous magazine of object pointers and only
+ * falls back to the cache-wide depot of full and empty magazines, under
+ * the cache lock, when both are exhausted.
+ */
+#define SLAB_ORDER 4
+#define SLAB_SIZE  (PAGE_SIZE << SLAB_ORDER)
+#define SLAB_MAGIC 0x51AB51ABu
+
+#define MAG_ROUNDS 30
+#define MAG_BYTES  16384 // caps what large objects park in one magazine
+#define DEPOT_MAX_FULL 8 // beyond this, full magazines are flushed to the slabs
+#define SLAB_KEEP_EMPTY 1 // empty slabs kept per cache before pages go back
+#define KMEM_NAME_LEN 24
+#define KMALLOC_CLASSES 13
+
+struct slab {
+    struct slab *next;
+    struct slab *prev;
+    struct slab **list;     // the cache list this slab is on
+    struct kmem_cache *cache;
+    void *freelist;
+    uint32_t inuse;
+    uint32_t magic;
+};
+
+struct magazine {
+    struct magazine *next;
+    uint64_t rounds;
+    void *objs[MAG_ROUNDS];
+};
+
+struct kmem_cpu {
+    struct magazine *loaded;
+    struct magazine *previous;
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t misses;    // operations that needed the cache lock
+} __attribute__((aligned(64)));
+
+struct kmem_cache {
+    char name[KMEM_NAME_LEN];
+    size_t size;            // object size asked for
+    size_t stride;          // bytes per object in a slab
+    size_t free_off;        // free pointer offset inside a free object
+    size_t first_off;       // first object, after the slab header
+    uint32_t per_slab;
+    uint32_t mag_rounds;    // magazine capacity used by this cache
+    unsigned int flags;
+    void (*ctor)(void *);
+    spinlock_t lock;
+
+    struct slab *partial;
+    struct slab *full;
+    struct slab *empty;
+    uint64_t nr_slabs;
+    uint64_t nr_empty;
+    uint64_t active;        // objects out of the slabs, magazines included
+
+    struct magazine *depot_full;
+    struct magazine *depot_empty;
+    uint64_t depot_rounds;
+    uint32_t depot_nr_full;
+
+    struct kmem_cache *next;
+    struct kmem_cpu cpu[MAX_CPUS];
+};
+
+static struct kmem_cache cache_cache;   // struct kmem_cache objects
+static struct kmem_cache mag_cache;     // struct magazine objects
+static struct kmem_cache kmalloc_caches[KMALLOC_CLASSES];
+static const size_t kmalloc_sizes[KMALLOC_CLASSES] = {
+    8, 16, 32, 64, 96, 128, 192, 256, 512, 1024, 2048, 4096, 8192,
+};
+
+// Class for sizes 1..192, indexed by (size - 1) / 8
+static const uint8_t kmalloc_index[24] = {
+    0, 1, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5,
+    6, 6, 6, 6, 6, 6, 6, 6,
+};
+
+static struct kmem_cache *cache_list;
+static DEFINE_SPINLOCK(cache_list_lock);
+
+static inline size_t align_up(size_t v, size_t a)
+{
+    return (v + a - 1) & ~(a - 1);
+}
+
+static uint64_t cache_lock(struct kmem_cache *c)
+{
+    return spin_lock_irqsave(&c->lock);
+}
+
+static void cache_unlock(struct kmem_cache *c, uint64_t flags)
+{
+    spin_unlock_irqrestore(&c->lock, flags);
+}
+
+static inline struct slab *slab_of(const void *obj)
+{
+    return (struct slab *)((uintptr_t)obj & ~(uintptr_t)(SLAB_SIZE - 1));
+}
+
+static inline void **free_ptr(struct kmem_cache *c, void *obj)
+{
+    return (void **)((uint8_t *)obj + c->free_off);
+}
+
+static void slab_list_del(struct slab *s)
+{
+    if (!s->list) return;
+
+    if (s->prev) s->prev->next = s->next;
+    else *s->list = s->next;
+    if (s->next) s->next->prev = s->prev;
+    s->list = NULL;
+}
+
+static void slab_list_move(struct slab *s, struct slab **list)
+{
+    slab_list_del(s);
+
+    s->prev = NULL;
+    s->next = *list;
+    if (*list) (*list)->prev = s;
+    *list = s;
+    s->list = list;
+}
+
+static struct slab *slab_grow(struct kmem_cache *c)
+{
+    uint64_t phys = pmm_alloc_pages(SLAB_ORDER, 0);
+    if (!phys) return NULL;
+
+    struct slab *s = phys_to_virt(phys);
+    s->list = NULL;
+    s->cache = c;
+    s->inuse = 0;
+    s->magic = SLAB_MAGIC;
+    s->freelist = NULL;
+
+    // Link back to front so objects are handed out in address order
+    uint8_t *base = (uint8_t *)s + c->first_off;
+    for (uint32_t i = c->per_slab; i-- > 0;) {
+        void *obj = base + (size_t)i * c->stride;
+        if (c->ctor) c->ctor(obj);
+        *free_ptr(c, obj) = s->freelist;
+        s->freelist = obj;
+    }
+
+    c->nr_slabs++;
+    c->nr_empty++;
+    slab_list_move(s, &c->empty);
+    return s;
+}
+
+// Slab layer, cache lock held
+static void *slab_alloc(struct kmem_cache *c)
+{
+    struct slab *s = c->partial;
+    if (!s) {
+        s = c->empty ? c->empty : slab_grow(c);
+        if (!s) return NULL;
+        c->nr_empty--;
+        slab_list_move(s, &c->partial);
+    }
+
+    void *obj = s->freelist;
+    s->freelist = *free_ptr(c, obj);
+    if (++s->inuse == c->per_slab) slab_list_move(s, &c->full);
+    c->active++;
+    return obj;
+}
+
+static void slab_free(struct kmem_cache *c, void *obj)
+{
+    struct slab *s = slab_of(obj);
+
+    *free_ptr(c, obj) = s->freelist;
+    s->freelist = obj;
+    c->active--;
+
+    if (--s->inuse == 0) {
+        if (c->nr_empty >= SLAB_KEEP_EMPTY) {
+            // Enough empty slabs around already, give the pages back
+            slab_list_del(s);
+            s->magic = 0;
+            c->nr_slabs--;
+            pmm_free_pages(virt_to_phys(s), SLAB_ORDER);
+            return;
+        }
+        c->nr_empty++;
+        slab_list_move(s, &c->empty);
+    } else if (s->list == &c->full) {
+        slab_list_move(s, &c->partial);
+    }
+}
+
+static void cache_setup(struct kmem_cache *c, const char *name, size_t size, size_t align,
+                        unsigned int flags, void (*ctor)(void *))
+{
+    k_memset(c, 0, sizeof(*c));
+    k_strncpy(c->name, name, KMEM_NAME_LEN - 1);
+    spin_lock_init(&c->lock);
+
+    if (align < sizeof(void *)) align = sizeof(void *);
+    c->size = size;
+    c->flags = flags;
+    c->ctor = ctor;
+
+    // A constructed object must survive being free, keep the link behind it
+    if (ctor) {
+        c->free_off = align_up(size, sizeof(void *));
+        c->stride = align_up(c->free_off + sizeof(void *), align);
+    } else {
+        c->free_off = 0;
+        c->stride = align_up(size < sizeof(void *) ? sizeof(void *) : size, align);
+    }
+    c->first_off = align_up(sizeof(struct slab), align);
+    c->per_slab = (uint32_t)((SLAB_SIZE - c->first_off) / c->stride);
+    c->mag_rounds = (uint32_t)(MAG_BYTES / c->stride);
+    if (c->mag_rounds > MAG_ROUNDS) c->mag_rounds = MAG_ROUNDS;
+    if (c->mag_rounds < 4) c->mag_rounds = 4;
+
+    spin_lock(&cache_list_lock);
+    c->next = cache_list;
+    cache_list = c;
+    spin_unlock(&cache_list_lock);
+}
+
+void slab_init(void)
+{
+    static char names[KMALLOC_CLASSES][KMEM_NAME_LEN];
+
+    cache_setup(&cache_cache, "kmem_cache", sizeof(struct kmem_cache), 64, SLAB_NO_MAGAZINE, NULL);
+    cache_setup(&mag_cache, "magazine", sizeof(struct magazine), 64, SLAB_NO_MAGAZINE, NULL);
+
+    for (int i = 0; i < KMALLOC_CLASSES; i++) {
+        size_t size = kmalloc_sizes[i];
+        size_t align = size & -size;
+        if (align > 64) align = 64;
+        snprintf(names[i], KMEM_NAME_LEN, "kmalloc-%lu", size);
+        cache_setup(&kmalloc_caches[i], names[i], size, align, 0, NULL);
+    }
+}
+
+struct kmem_cache *kmem_cache_create(const char *name, size_t size, size_t align,
+                                     unsigned int flags, void (*ctor)(void *))
+{
+    if (size == 0 || size > SLAB_SIZE / 2 || (align & (align - 1))) return NULL;
+
+    struct kmem_cache *c = kmem_cache_alloc(&cache_cache);
+    if (!c) return NULL;
+    cache_setup(c, name, size, align, flags, ctor);
+    return c;
+}
+
+void *kmem_cache_alloc(struct kmem_cache *c)
+{
+    uint64_t flags = int_save();
+    struct kmem_cpu *cc = &c->cpu[cpu_id()];
+    struct magazine *m;
+    void *obj;
+
+    cc->allocs++;
+    if (c->flags & SLAB_NO_MAGAZINE) goto slow;
+
+    if ((m = cc->loaded) && m->rounds) {
+        obj = m->objs[--m->rounds];
+        int_restore(flags);
+        return obj;
+    }
+    if ((m = cc->previous) && m->rounds) {
+        cc->previous = cc->loaded;
+        cc->loaded = m;
+        obj = m->objs[--m->rounds];
+        int_restore(flags);
+        return obj;
+    }
+
+slow:
+    cc->misses++;
+    uint64_t lflags = cache_lock(c);
+    if (!(c->flags & SLAB_NO_MAGAZINE) && (m = c->depot_full)) {
+        // Trade the empty previous magazine for a full one from the depot
+        c->depot_full = m->next;
+        c->depot_nr_full--;
+        c->depot_rounds -= m->rounds;
+        if (cc->previous) {
+            cc->previous->next = c->depot_empty;
+            c->depot_empty = cc->previous;
+        }
+        cc->previous = cc->loaded;
+        cc->loaded = m;
+        obj = m->objs[--m->rounds];
+    } else {
+        obj = slab_alloc(c);
+    }
+    cache_unlock(c, lflags);
+
+    int_restore(flags);
+    return obj;
+}
+
+void kmem_cache_free(struct kmem_cache *c, void *obj)
+{
+    struct slab *s = slab_of(obj);
+    if (!obj || s->magic != SLAB_MAGIC || s->cache != c) {
+        printk(KERN_ERR "slab: %s: bad free of %p\n", c->name, obj);
+        return;
+    }
+
+    uint64_t flags = int_save();
+    struct kmem_cpu *cc = &c->cpu[cpu_id()];
+    struct magazine *m;
+
+    cc->frees++;
+    if (c->flags & SLAB_NO_MAGAZINE) goto slow;
+
+    if ((m = cc->loaded) && m->rounds < c->mag_rounds) {
+        m->objs[m->rounds++] = obj;
+        int_restore(flags);
+        return;
+    }
+    if ((m = cc->previous) && m->rounds < c->mag_rounds) {
+        cc->previous = cc->loaded;
+        cc->loaded = m;
+        m->objs[m->rounds++] = obj;
+        int_restore(flags);
+        return;
+    }
+
+    // Both magazines are full: swap one for an empty magazine
+    cc->misses++;
+    uint64_t lflags = cache_lock(c);
+    if (cc->previous && c->depot_nr_full >= DEPOT_MAX_FULL) {
+        // The depot holds enough, empty the previous magazine into the slabs
+        m = cc->previous;
+        while (m->rounds) slab_free(c, m->objs[--m->rounds]);
+    } else {
+        m = c->depot_empty;
+        if (m) {
+            c->depot_empty = m->next;
+        } else {
+            cache_unlock(c, lflags);
+            m = kmem_cache_alloc(&mag_cache);
+            lflags = cache_lock(c);
+        }
+        if (m && cc->previous) {
+            cc->previous->next = c->depot_full;
+            c->depot_full = cc->previous;
+            c->depot_nr_full++;
+            c->depot_rounds += cc->previous->rounds;
+        }
+    }
+    if (m) {
+        m->rounds = 0;
+        cc->previous = cc->loaded;
+        cc->loaded = m;
+        m->objs[m->rounds++] = obj;
+        cache_unlock(c, lflags);
+        int_restore(flags);
+        return;
+    }
+    cache_unlock(c, lflags);
+
+slow:
+    lflags = cache_lock(c);
+    slab_free(c, obj);
+    cache_unlock(c, lflags);
+    int_restore(flags);
+}
+
+static inline int kmalloc_class(size_t size)
+{
+    if (size <= 192) return kmalloc_index[(size - 1) / 8];
+    return 63 - __builtin_clzll(size - 1);
+}
+
+void *kmalloc(size_t size)
+{
+    if (size == 0 || size > KMALLOC_MAX_SIZE) return NULL;
+    return kmem_cache_alloc(&kmalloc_caches[kmalloc_class(size)]);
+}
+
+void *kzalloc(size_t size)
+{
+    void *p = kmalloc(size);
+    if (p) k_memset(p, 0, size);
+    return p;
+}
+
+void kfree(void *obj)
+{
+    if (!obj) return;
+
+    struct slab *s = slab_of(obj);
+    if (s->magic != SLAB_MAGIC) {
+        printk(KERN_ERR "slab: kfree of %p outside any slab\n", obj);
+        return;
+    }
+    kmem_cache_free(s->cache, obj);
+}
+
+/*
+ * One line per cache. "cached" objects sit in magazines: allocated from
+ * the slabs' point of view, free for users. waste is the part of the
+ * slab pages not holding live objects, as a percentage.
+ */
+void kmem_report(void)
+{
+    printk("slab: %-14s %6s %8s %8s %8s %6s %5s %6s %8s\n",
+           "cache", "size", "inuse", "cached", "total", "slabs", "occ%", "waste%", "misses");
+
+    for (struct kmem_cache *c = cache_list; c; c = c->next) {
+        uint64_t cached = 0, allocs = 0, misses = 0;
+
+        uint64_t lflags = cache_lock(c);
+        for (int i = 0; i < MAX_CPUS; i++) {
+            struct kmem_cpu *cc = &c->cpu[i];
+            if (cc->loaded) cached += cc->loaded->rounds;
+            if (cc->previous) cached += cc->previous->rounds;
+            allocs += cc->allocs + cc->frees;
+            misses += cc->misses;
+        }
+        cached += c->depot_rounds;
+        uint64_t active = c->active, slabs = c->nr_slabs;
+        cache_unlock(c, lflags);
+
+        if (!allocs) continue;
+
+        uint64_t total = slabs * c->per_slab;
+        uint64_t inuse = active - cached;
+        uint64_t bytes = slabs * SLAB_SIZE;
+        uint64_t occ = total ? active * 100 / total : 0;
+        uint64_t waste = bytes ? (bytes - inuse * c->size) * 100 / bytes : 0;
+
+        printk("slab: %-14s %6lu %8lu %8lu %8lu %6lu %5lu %6lu %8lu\n",
+               c->name, c->size, inuse, cached, total, slabs, occ, waste, misses);
+    }
+}
@@ -0,0 +1,250 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <kernel/apic.h>
+#include <kernel/cpu.h>
+#include <kernel/gdt.h>
+#include <kernel/hrtimer.h>
+#include <kernel/idt.h>
+#include <kernel/lib/string.h>
+#include <kernel/paging.h>
+#include <kernel/percpu.h>
+#include <kernel/pmm.h>
+#include <kernel/printk.h>
+#include <kernel/sched.h>
+#include <kernel/smp.h>
+#include <kernel/time.h>
+#include <kernel/vmm.h>
+
+#define TRAMPOLINE_BASE 0x8000  // below 1 MiB and page aligned, must match trampoline.s
+#define AP_STACK_ORDER  2       // 16 KiB
+
+#define MSR_EFER    0xC0000080
+#define MSR_GS_BASE 0xC0000101
+#define EFER_LME    (1 << 8)
+#define EFER_NXE    (1 << 11)
+#define CR4_OSXSAVE (1 << 18)
+
+#define INIT_DELAY_US    10000
+#define STARTUP_DELAY_US 200
+#define AP_TIMEOUT_US    100000
+
+struct trampoline_params {
+    uint64_t cr3;
+    uint64_t efer;
+    uint64_t cr0;
+    uint64_t cr4;
+    uint64_t xcr0;
+    uint64_t stack;
+    uint64_t entry;
+    uint64_t arg;
+};
+
+extern uint8_t trampoline_start[], trampoline_end[];
+extern struct trampoline_params trampoline_params;
+
+// Linker symbols: the template's load address and, linked at 0, its size
+extern uint8_t percpu_load[], percpu_end[];
+
+DEFINE_PER_CPU(unsigned int, cpu_number);
+DEFINE_PER_CPU(uintptr_t, this_cpu_off);
+DEFINE_PER_CPU(uint32_t, cpu_apic_id);
+
+uintptr_t percpu_offset[MAX_CPUS];  // boot.s fills in the boot CPU's
+unsigned int nr_cpus = 1;
+
+static bool ap_alive;
+
+static unsigned int size_order(uint64_t size)
+{
+    unsigned int order = 0;
+    while (((uint64_t)PAGE_SIZE << order) < size) order++;
+    return order;
+}
+
+// A fresh copy of the template for cpu
+static bool percpu_alloc(unsigned int cpu, uint32_t apic_id)
+{
+    uint64_t size = (uint64_t)(uintptr_t)percpu_end;
+    uint64_t phys = pmm_alloc_pages(size_order(size), 0);
+    if (!phys) return false;
+
+    uint8_t *area = phys_to_virt(phys);
+    k_memcpy(area, percpu_load, size);
+    percpu_offset[cpu] = (uintptr_t)area;
+    *per_cpu_ptr(cpu_number, cpu) = cpu;
+    *per_cpu_ptr(this_cpu_off, cpu) = (uintptr_t)area;
+    *per_cpu_ptr(cpu_apic_id, cpu) = apic_id;
+    return true;
+}
+
+static void percpu_free(unsigned int cpu)
+{
+    pmm_free_pages(virt_to_phys((void *)percpu_offset[cpu]), size_order((uint64_t)(uintptr_t)percpu_end));
+    percpu_offset[cpu] = 0;
+}
+
+/*
+ * The kernel half plus an identity mapping of the first 2 MiB, which
+ * the trampoline runs from while it turns paging on. The PML4 must be
+ * below 4 GiB: it is loaded into CR3 from 32-bit code.
+ */
+static uint64_t trampoline_tables(void)
+{
+    uint64_t pml4 = pmm_alloc_page(PMM_DMA32 | PMM_ZERO);
+    uint64_t pdpt = pmm_alloc_page(PMM_ZERO);
+    uint64_t pd = pmm_alloc_page(PMM_ZERO);
+    if (!pml4 || !pdpt || !pd) {
+        if (pml4) pmm_free_page(pml4);
+        if (pdpt) pmm_free_page(pdpt);
+        if (pd) pmm_free_page(pd);
+        return 0;
+    }
+
+    uint64_t *t = phys_to_virt(pml4);
+    for (int i = 256; i < 512; i++) t[i] = kernel_space.pml4[i];
+    t[0] = pdpt | PTE_PRESENT | PTE_WRITE;
+    ((uint64_t *)phys_to_virt(pdpt))[0] = pd | PTE_PRESENT | PTE_WRITE;
+    ((uint64_t *)phys_to_virt(pd))[0] = PTE_PRESENT | PTE_WRITE | PTE_HUGE;
+    return pml4;
+}
+
+static void trampoline_tables_free(uint64_t pml4)
+{
+    uint64_t pdpt = ((uint64_t *)phys_to_virt(pml4))[0] & PTE_ADDR;
+    uint64_t pd = ((uint64_t *)phys_to_virt(pdpt))[0] & PTE_ADDR;
+    pmm_free_page(pd);
+    pmm_free_page(pdpt);
+    pmm_free_page(pml4);
+}
+
+// First C code on a secondary CPU, still on the trampoline's tables and GDT
+static __attribute__((noreturn)) void ap_start(unsigned int cpu)
+{
+    wrmsr(MSR_GS_BASE, percpu_offset[cpu]);
+    gdt_init();
+    idt_load();
+    vmm_init_cpu();
+    pat_init();
+    lapic_init_cpu();
+    hrtimer_init_cpu();
+    sched_init_cpu();
+
+    __atomic_store_n(&ap_alive, true, __ATOMIC_RELEASE);
+    sched_idle();
+}
+
+static bool ap_wait(uint64_t us)
+{
+    uint64_t end = ktime_get_ns() + us * NSEC_PER_USEC;
+    while (ktime_get_ns() < end) {
+        if (__atomic_load_n(&ap_alive, __ATOMIC_ACQUIRE)) return true;
+        asm volatile ("pause");
+    }
+    return __atomic_load_n(&ap_alive, __ATOMIC_ACQUIRE);
+}
+
+// INIT, then up to two startup IPIs, as in the MP specification
+static bool ap_boot(uint32_t apic_id, struct trampoline_params *params, unsigned int cpu)
+{
+    uint64_t stack = pmm_alloc_pages(AP_STACK_ORDER, 0);
+    if (!stack) return false;
+
+    params->stack = (uint64_t)(uintptr_t)phys_to_virt(stack) + (PAGE_SIZE << AP_STACK_ORDER);
+    params->arg = cpu;
+    __atomic_store_n(&ap_alive, false, __ATOMIC_RELEASE);
+
+    lapic_send_init(apic_id);
+    udelay(INIT_DELAY_US);
+    for (int i = 0; i < 2; i++) {
+        lapic_send_startup(apic_id, TRAMPOLINE_BASE >> PAGE_SHIFT);
+        if (ap_wait(i ? AP_TIMEOUT_US : STARTUP_DELAY_US)) return true;
+    }
+
+    // INIT again parks it in wait-for-SIPI for good, so the stack can go
+    lapic_send_init(apic_id);
+    pmm_free_pages(stack, AP_STACK_ORDER);
+    return false;
+}
+
+/*
+ * Start every other processor in the MADT, one at a time since they
+ * share the trampoline. Needs the APIC, the calibrated TSC and
+ * the kernel address space. Each CPU gets a copy of the per-CPU
+ * template, its own stack, GDT and TSS, then becomes that CPU's idle
+ * thread and takes work from the other run queues.
+ */
+void smp_init(void)
+{
+    unsigned int count = apic_cpu_count();
+    if (count <= 1) {
+        printk("smp: 1 CPU\n");
+        return;
+    }
+    this_cpu_write(cpu_apic_id, lapic_id());
+
+    size_t size = trampoline_end - trampoline_start;
+    if (!pmm_is_ram(TRAMPOLINE_BASE, TRAMPOLINE_BASE + PAGE_SIZE)) {
+        printk(KERN_ERR "smp: no RAM at %#x for the trampoline\n", TRAMPOLINE_BASE);
+        return;
+    }
+    uint64_t pml4 = trampoline_tables();
+    if (!pml4) {
+        printk(KERN_ERR "smp: out of memory\n");
+        return;
+    }
+
+    uint8_t *tramp = phys_to_virt(TRAMPOLINE_BASE);
+    k_memcpy(tramp, trampoline_start, size);
+    struct trampoline_params *params =
+        (struct trampoline_params *)(tramp + ((uint8_t *)&trampoline_params - trampoline_start));
+
+    uint64_t cr0;
+    asm volatile ("mov %%cr0, %0" : "=r" (cr0));
+    params->cr3 = pml4;
+    params->efer = EFER_LME | (rdmsr(MSR_EFER) & EFER_NXE);
+    params->cr0 = cr0;
+    params->cr4 = read_cr4();
+    params->xcr0 = (params->cr4 & CR4_OSXSAVE) ? xgetbv(0) : 0;
+    params->entry = (uint64_t)(uintptr_t)ap_start;
+
+    uint32_t self = lapic_id();
+    for (unsigned int i = 0; i < count && nr_cpus < MAX_CPUS; i++) {
+        uint32_t apic_id = apic_cpu_id(i);
+        if (apic_id == self) continue;
+
+        unsigned int cpu = nr_cpus;
+        if (!percpu_alloc(cpu, apic_id)) {
+            printk(KERN_ERR "smp: out of memory\n");
+            break;
+        }
+        if (!ap_boot(apic_id, params, cpu)) {
+            printk(KERN_WARN "smp: APIC %u did not start\n", apic_id);
+            percpu_free(cpu);
+            continue;
+        }
+        nr_cpus++;
+    }
+
+    trampoline_tables_free(pml4);
+    printk("smp: %u of %u CPUs online, %lu bytes per-CPU data each\n",
+           nr_cpus, count, (uint64_t)(uintptr_t)percpu_end);
+}
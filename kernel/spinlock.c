@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <kernel/cpu.h>
+#include <kernel/percpu.h>
+#include <kernel/printk.h>
+#include <kernel/spinlock.h>
+
+/*
+ * One queue node per nesting level a CPU can spin at: normal code,
+ * interrupt, NMI and machine check. The tail field of a lock names the
+ * last node as (cpu + 1) << 2 | level.
+ */
+#define MCS_NODES 4
+
+struct mcs_node {
+    struct mcs_node *next;
+    uint32_t locked;    // set by the predecessor when this node heads the queue
+    uint32_t count;     // nesting depth, kept in node 0
+} __attribute__((aligned(64)));
+
+static DEFINE_PER_CPU(struct mcs_node, mcs_nodes[MCS_NODES]);
+
+static inline uint16_t encode_tail(unsigned int cpu, unsigned int idx)
+{
+    return (uint16_t)((cpu + 1) << 2 | idx);
+}
+
+static inline struct mcs_node *decode_tail(uint16_t tail)
+{
+    return &(*per_cpu_ptr(mcs_nodes, (tail >> 2) - 1))[tail & 3];
+}
+
+void spin_lock_slowpath(spinlock_t *lock)
+{
+#ifdef CONFIG_LOCKSTAT
+    uint64_t start = rdtsc();
+#endif
+    struct mcs_node *nodes = *this_cpu_ptr(mcs_nodes);
+    unsigned int idx = nodes[0].count++;
+    asm volatile ("" : : : "memory");   // claim the node before an interrupt can
+
+    if (idx >= MCS_NODES) {
+        // Deeper nesting than can happen; spin on the word rather than fail
+        uint32_t unlocked = 0;
+        while (!__atomic_compare_exchange_n(&lock->val, &unlocked, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            unlocked = 0;
+            asm volatile ("pause");
+        }
+        goto out;
+    }
+
+    struct mcs_node *node = &nodes[idx];
+    node->next = NULL;
+    node->locked = 0;
+    uint16_t tail = encode_tail(cpu_id(), idx);
+
+    // Join the queue; only a previous waiter makes this CPU wait its turn
+    uint16_t old = __atomic_exchange_n(&lock->tail, tail, __ATOMIC_ACQ_REL);
+    if (old) {
+        __atomic_store_n(&decode_tail(old)->next, node, __ATOMIC_RELEASE);
+        while (!__atomic_load_n(&node->locked, __ATOMIC_ACQUIRE)) {
+            asm volatile ("pause");
+        }
+    }
+
+    // Head of the queue: wait for the owner to let go
+    uint32_t val;
+    while ((val = __atomic_load_n(&lock->val, __ATOMIC_ACQUIRE)) & 0xFF) {
+        asm volatile ("pause");
+    }
+
+    // Last in the queue: take the lock and empty the queue in one go
+    if ((val >> 16) == tail &&
+        __atomic_compare_exchange_n(&lock->val, &val, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        goto out;
+    }
+
+    // Nobody else can take it while the queue is not empty
+    __atomic_store_n(&lock->locked, 1, __ATOMIC_RELAXED);
+
+    struct mcs_node *next;
+    while (!(next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE))) {
+        asm volatile ("pause");
+    }
+    __atomic_store_n(&next->locked, 1, __ATOMIC_RELEASE);
+
+out:
+    asm volatile ("" : : : "memory");
+    nodes[0].count--;
+#ifdef CONFIG_LOCKSTAT
+    if (lock->class) {
+        __atomic_fetch_add(&lock->class->contended, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&lock->class->wait_cycles, rdtsc() - start, __ATOMIC_RELAXED);
+    }
+#endif
+}
+
+void read_lock_slowpath(rwlock_t *rw)
+{
+    // Back out and queue behind the writer
+    __atomic_sub_fetch(&rw->cnts, RW_READER, __ATOMIC_RELAXED);
+    spin_lock(&rw->wait);
+    __atomic_add_fetch(&rw->cnts, RW_READER, __ATOMIC_RELAXED);
+
+    // Any writer ahead in the queue has the lock by now; wait for it to finish
+    while (__atomic_load_n(&rw->cnts, __ATOMIC_ACQUIRE) & RW_LOCKED) {
+        asm volatile ("pause");
+    }
+    spin_unlock(&rw->wait);
+}
+
+void write_lock_slowpath(rwlock_t *rw)
+{
+    spin_lock(&rw->wait);
+
+    uint32_t cnts = 0;
+    if (__atomic_compare_exchange_n(&rw->cnts, &cnts, RW_LOCKED, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        spin_unlock(&rw->wait);
+        return;
+    }
+
+    // Turn new readers away, then wait for the current ones to drain
+    __atomic_fetch_or(&rw->cnts, RW_WAITING, __ATOMIC_RELAXED);
+    for (;;) {
+        cnts = RW_WAITING;
+        if (__atomic_load_n(&rw->cnts, __ATOMIC_RELAXED) == RW_WAITING &&
+            __atomic_compare_exchange_n(&rw->cnts, &cnts, RW_LOCKED, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+        asm volatile ("pause");
+    }
+    spin_unlock(&rw->wait);
+}
+
+#ifdef CONFIG_LOCKSTAT
+static struct lock_class *lock_classes;
+
+// Classes join the report list the first time one of their locks is taken
+static void lockstat_register(struct lock_class *class)
+{
+    if (__atomic_exchange_n(&class->registered, true, __ATOMIC_RELAXED)) return;
+
+    struct lock_class *head = __atomic_load_n(&lock_classes, __ATOMIC_RELAXED);
+    do {
+        class->next = head;
+    } while (!__atomic_compare_exchange_n(&lock_classes, &head, class, true,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+void lockstat_acquired(spinlock_t *lock)
+{
+    struct lock_class *class = lock->class;
+    if (!class) return;
+
+    if (!__atomic_load_n(&class->registered, __ATOMIC_RELAXED)) lockstat_register(class);
+    __atomic_fetch_add(&class->acquired, 1, __ATOMIC_RELAXED);
+    lock->acquired_at = rdtsc();
+}
+
+void lockstat_released(spinlock_t *lock)
+{
+    struct lock_class *class = lock->class;
+    if (!class) return;
+
+    uint64_t held = rdtsc() - lock->acquired_at;
+    uint64_t max = __atomic_load_n(&class->max_hold_cycles, __ATOMIC_RELAXED);
+    while (held > max && !__atomic_compare_exchange_n(&class->max_hold_cycles, &max, held, true,
+                                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) { }
+}
+
+void lockstat_report(void)
+{
+    struct lock_class *class = __atomic_load_n(&lock_classes, __ATOMIC_ACQUIRE);
+    for (; class; class = class->next) {
+        uint64_t contended = class->contended;
+        printk("lockstat: %-24s %8lu taken, %6lu contended (avg wait %lu cycles), longest hold %lu cycles\n",
+               class->name, class->acquired, contended,
+               contended ? class->wait_cycles / contended : 0, class->max_hold_cycles);
+    }
+}
+#else
+void lockstat_report(void)
+{
+}
+#endif
@@ -20,18 +20,114 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <immintrin.h>
 #include <kernel/lib/string.h>
+#include <kernel/cpu.h>
+#include <kernel/fpu.h>
+
+#define SSE2 __attribute__((target("sse2")))
+#define AVX2 __attribute__((target("avx2")))
+
+/* Copies at or above this size go through rep movsb/stosb (ERMS) */
+#define ERMS_THRESHOLD 2048
+
+/* Below this the integer code wins over entering a kernel FPU section */
+#define VECTOR_THRESHOLD 64
+
+typedef void (*memcpy_fn_t)(void *, const void *, size_t);
+typedef void (*memset_fn_t)(void *, uint8_t, size_t);
+typedef int (*memcmp_fn_t)(const void *, const void *, size_t);
+typedef size_t (*strlen_fn_t)(const char *);
+typedef void (*memmove_back_fn_t)(uint8_t *, const uint8_t *, size_t);
+
+static void memcpy_generic(void *dest, const void *src, size_t len);
+static void memset_generic(void *dest, uint8_t val, size_t len);
+static int memcmp_generic(const void *s1, const void *s2, size_t n);
+static size_t strlen_generic(const char *src);
+static void memmove_back_generic(uint8_t *d, const uint8_t *s, size_t len);
+
+/* Safe defaults until k_string_init() has looked at CPUID */
+static memcpy_fn_t memcpy_impl = memcpy_generic;
+static memset_fn_t memset_impl = memset_generic;
+static memcmp_fn_t memcmp_impl = memcmp_generic;
+static strlen_fn_t strlen_impl = strlen_generic;
+static memmove_back_fn_t memmove_back_impl = memmove_back_generic;
+static size_t rep_movsb_threshold = SIZE_MAX;
+static size_t rep_stosb_threshold = SIZE_MAX;
+static const char *string_variant = "generic";
+static bool vector_ok = false;
+
+static inline uint64_t load64(const void *p)
+{
+    uint64_t v;
+    __builtin_memcpy(&v, p, sizeof(v));
+    return v;
+}
 
-void k_memcpy(void *dest, const void *src, size_t len)
+static inline void store64(void *p, uint64_t v)
 {
-    if (len == 0 || dest == src) return;
+    __builtin_memcpy(p, &v, sizeof(v));
+}
 
+static inline uint32_t load32(const void *p)
+{
+    uint32_t v;
+    __builtin_memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void store32(void *p, uint32_t v)
+{
+    __builtin_memcpy(p, &v, sizeof(v));
+}
+
+/* len < 16: every load happens before any store, so overlap is fine */
+static inline void copy_small(uint8_t *d, const uint8_t *s, size_t len)
+{
+    if (len >= 8) {
+        uint64_t a = load64(s);
+        uint64_t b = load64(s + len - 8);
+        store64(d, a);
+        store64(d + len - 8, b);
+    } else if (len >= 4) {
+        uint32_t a = load32(s);
+        uint32_t b = load32(s + len - 4);
+        store32(d, a);
+        store32(d + len - 4, b);
+    } else if (len) {
+        uint8_t a = s[0];
+        uint8_t b = s[len / 2];
+        uint8_t c = s[len - 1];
+        d[0] = a;
+        d[len / 2] = b;
+        d[len - 1] = c;
+    }
+}
+
+static inline void rep_movsb(void *dest, const void *src, size_t len)
+{
+    asm volatile ("rep movsb" : "+D" (dest), "+S" (src), "+c" (len) : : "memory");
+}
+
+static inline void rep_stosb(void *dest, uint8_t val, size_t len)
+{
+    asm volatile ("rep stosb" : "+D" (dest), "+c" (len) : "a" (val) : "memory");
+}
+
+/* The vector variants run inside a kernel FPU section, see fpu.h */
+static inline bool vector_begin(size_t len)
+{
+    return vector_ok && len >= VECTOR_THRESHOLD && kernel_fpu_begin();
+}
+
+static void memcpy_generic(void *dest, const void *src, size_t len)
+{
     uint8_t *d = (uint8_t *)dest;
     const uint8_t *s = (const uint8_t *)src;
 
     /* Small copies - unrolled byte copy is fastest for tiny sizes */
     if (len < 16) {
-        for (size_t i = 0; i < len; i++) d[i] = s[i];
+        copy_small(d, s, len);
         return;
     }
 
@@ -45,7 +141,7 @@ void k_memcpy(void *dest, const void *src, size_t len)
     const uint64_t *ws = (const uint64_t *)s;
 
     size_t words = len / 8;
-    for (size_t i = 0; i < words; i++) wd[i] = ws[i];
+    for (size_t i = 0; i < words; i++) wd[i] = load64(ws + i);
 
     d = (uint8_t *)(wd + words);
     s = (const uint8_t *)(ws + words);
@@ -53,9 +149,124 @@ void k_memcpy(void *dest, const void *src, size_t len)
     for (size_t i = 0; i < rem; i++) d[i] = s[i];
 }
 
-void k_memset(void *dest, uint8_t val, size_t len)
+/*
+ * Vector copies load the (unaligned) head and tail up front, stream the
+ * body with aligned stores and write head and tail last. Every load happens
+ * before the store that could clobber it, so a forward copy with
+ * dest < src is safe for k_memmove as well.
+ */
+SSE2 static void memcpy_sse2(void *dest, const void *src, size_t len)
+{
+    uint8_t *d = (uint8_t *)dest;
+    const uint8_t *s = (const uint8_t *)src;
+
+    if (len < 16) {
+        copy_small(d, s, len);
+        return;
+    }
+    __m128i head = _mm_loadu_si128((const __m128i *)s);
+    __m128i tail = _mm_loadu_si128((const __m128i *)(s + len - 16));
+    if (len <= 32) {
+        _mm_storeu_si128((__m128i *)d, head);
+        _mm_storeu_si128((__m128i *)(d + len - 16), tail);
+        return;
+    }
+
+    uint8_t *tail_dst = d + len - 16;
+    uint8_t *head_dst = d;
+    size_t skew = 16 - ((uintptr_t)d & 15);
+    d += skew;
+    s += skew;
+    len -= skew;
+
+    while (len >= 64) {
+        __m128i a = _mm_loadu_si128((const __m128i *)s);
+        __m128i b = _mm_loadu_si128((const __m128i *)(s + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(s + 32));
+        __m128i e = _mm_loadu_si128((const __m128i *)(s + 48));
+        _mm_store_si128((__m128i *)d, a);
+        _mm_store_si128((__m128i *)(d + 16), b);
+        _mm_store_si128((__m128i *)(d + 32), c);
+        _mm_store_si128((__m128i *)(d + 48), e);
+        d += 64;
+        s += 64;
+        len -= 64;
+    }
+    while (len >= 16) {
+        _mm_store_si128((__m128i *)d, _mm_loadu_si128((const __m128i *)s));
+        d += 16;
+        s += 16;
+        len -= 16;
+    }
+    _mm_storeu_si128((__m128i *)head_dst, head);
+    _mm_storeu_si128((__m128i *)tail_dst, tail);
+}
+
+AVX2 static void memcpy_avx2(void *dest, const void *src, size_t len)
+{
+    uint8_t *d = (uint8_t *)dest;
+    const uint8_t *s = (const uint8_t *)src;
+
+    if (len <= 32) {
+        memcpy_sse2(d, s, len);
+        return;
+    }
+    __m256i head = _mm256_loadu_si256((const __m256i *)s);
+    __m256i tail = _mm256_loadu_si256((const __m256i *)(s + len - 32));
+    if (len <= 64) {
+        _mm256_storeu_si256((__m256i *)d, head);
+        _mm256_storeu_si256((__m256i *)(d + len - 32), tail);
+        return;
+    }
+
+    uint8_t *tail_dst = d + len - 32;
+    uint8_t *head_dst = d;
+    size_t skew = 32 - ((uintptr_t)d & 31);
+    d += skew;
+    s += skew;
+    len -= skew;
+
+    while (len >= 128) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)s);
+        __m256i b = _mm256_loadu_si256((const __m256i *)(s + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i *)(s + 64));
+        __m256i e = _mm256_loadu_si256((const __m256i *)(s + 96));
+        _mm256_store_si256((__m256i *)d, a);
+        _mm256_store_si256((__m256i *)(d + 32), b);
+        _mm256_store_si256((__m256i *)(d + 64), c);
+        _mm256_store_si256((__m256i *)(d + 96), e);
+        d += 128;
+        s += 128;
+        len -= 128;
+    }
+    while (len >= 32) {
+        _mm256_store_si256((__m256i *)d, _mm256_loadu_si256((const __m256i *)s));
+        d += 32;
+        s += 32;
+        len -= 32;
+    }
+    _mm256_storeu_si256((__m256i *)head_dst, head);
+    _mm256_storeu_si256((__m256i *)tail_dst, tail);
+}
+
+void k_memcpy(void *dest, const void *src, size_t len)
+{
+    if (len == 0 || dest == src) return;
+
+    if (len >= rep_movsb_threshold) {
+        rep_movsb(dest, src, len);
+        return;
+    }
+    if (vector_begin(len)) {
+        memcpy_impl(dest, src, len);
+        kernel_fpu_end();
+        return;
+    }
+    memcpy_generic(dest, src, len);
+}
+
+static void memset_generic(void *dest, uint8_t val, size_t len)
 {
-    if (len == 0) return;
     uint8_t *d = (uint8_t *)dest;
 
     /* Fill leading bytes until aligned */
@@ -78,6 +289,76 @@ void k_memset(void *dest, uint8_t val, size_t len)
     for (size_t i = 0; i < rem; i++) d[i] = val;
 }
 
+SSE2 static void memset_sse2(void *dest, uint8_t val, size_t len)
+{
+    uint8_t *d = (uint8_t *)dest;
+
+    if (len < 16) {
+        memset_generic(d, val, len);
+        return;
+    }
+    __m128i v = _mm_set1_epi8((char)val);
+    uint8_t *end = d + len;
+    _mm_storeu_si128((__m128i *)d, v);
+    _mm_storeu_si128((__m128i *)(end - 16), v);
+
+    d = (uint8_t *)(((uintptr_t)d + 16) & ~(uintptr_t)15);
+    while (d + 64 <= end) {
+        _mm_store_si128((__m128i *)d, v);
+        _mm_store_si128((__m128i *)(d + 16), v);
+        _mm_store_si128((__m128i *)(d + 32), v);
+        _mm_store_si128((__m128i *)(d + 48), v);
+        d += 64;
+    }
+    while (d + 16 <= end) {
+        _mm_store_si128((__m128i *)d, v);
+        d += 16;
+    }
+}
+
+AVX2 static void memset_avx2(void *dest, uint8_t val, size_t len)
+{
+    uint8_t *d = (uint8_t *)dest;
+
+    if (len < 32) {
+        memset_sse2(d, val, len);
+        return;
+    }
+    __m256i v = _mm256_set1_epi8((char)val);
+    uint8_t *end = d + len;
+    _mm256_storeu_si256((__m256i *)d, v);
+    _mm256_storeu_si256((__m256i *)(end - 32), v);
+
+    d = (uint8_t *)(((uintptr_t)d + 32) & ~(uintptr_t)31);
+    while (d + 128 <= end) {
+        _mm256_store_si256((__m256i *)d, v);
+        _mm256_store_si256((__m256i *)(d + 32), v);
+        _mm256_store_si256((__m256i *)(d + 64), v);
+        _mm256_store_si256((__m256i *)(d + 96), v);
+        d += 128;
+    }
+    while (d + 32 <= end) {
+        _mm256_store_si256((__m256i *)d, v);
+        d += 32;
+    }
+}
+
+void k_memset(void *dest, uint8_t val, size_t len)
+{
+    if (len == 0) return;
+
+    if (len >= rep_stosb_threshold) {
+        rep_stosb(dest, val, len);
+        return;
+    }
+    if (vector_begin(len)) {
+        memset_impl(dest, val, len);
+        kernel_fpu_end();
+        return;
+    }
+    memset_generic(dest, val, len);
+}
+
 void k_bzero(void *dest, size_t len)
 {
     k_memset(dest, 0, len);
@@ -141,7 +422,7 @@ char *k_strncpy(char *dest, const char *src, size_t n)
     return dest;
 }
 
-int k_memcmp(const void *s1, const void *s2, size_t n)
+static int memcmp_generic(const void *s1, const void *s2, size_t n)
 {
     const uint8_t *a = (const uint8_t *)s1;
     const uint8_t *b = (const uint8_t *)s2;
@@ -160,19 +441,17 @@ int k_memcmp(const void *s1, const void *s2, size_t n)
         a++; b++; n--;
     }
 
-    const uint64_t *wa = (const uint64_t *)a;
-    const uint64_t *wb = (const uint64_t *)b;
     size_t words = n / 8;
     for (size_t i = 0; i < words; i++) {
-        if (wa[i] != wb[i]) {
+        if (load64(a + i * 8) != load64(b + i * 8)) {
             /* find differing byte within the word */
-            a = (const uint8_t *)(wa + i);
-            b = (const uint8_t *)(wb + i);
+            a += i * 8;
+            b += i * 8;
             for (size_t j = 0; j < 8; j++) if (a[j] != b[j]) return (int)a[j] - (int)b[j];
         }
     }
-    a = (const uint8_t *)(wa + words);
-    b = (const uint8_t *)(wb + words);
+    a += words * 8;
+    b += words * 8;
     size_t rem = n & 7;
     for (size_t i = 0; i < rem; i++) {
         if (a[i] != b[i]) return (int)a[i] - (int)b[i];
@@ -180,21 +459,157 @@ int k_memcmp(const void *s1, const void *s2, size_t n)
     return 0;
 }
 
+/* Returns the index of the first differing byte, or 16 if equal */
+SSE2 static inline unsigned diff16(const uint8_t *a, const uint8_t *b)
+{
+    __m128i x = _mm_loadu_si128((const __m128i *)a);
+    __m128i y = _mm_loadu_si128((const __m128i *)b);
+    unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) ^ 0xFFFF;
+    return mask ? (unsigned)__builtin_ctz(mask) : 16;
+}
+
+SSE2 static int memcmp_sse2(const void *s1, const void *s2, size_t n)
+{
+    const uint8_t *a = (const uint8_t *)s1;
+    const uint8_t *b = (const uint8_t *)s2;
+    unsigned i;
+
+    if (n < 16) return memcmp_generic(a, b, n);
+
+    size_t off = 0;
+    for (; off + 16 <= n; off += 16) {
+        if ((i = diff16(a + off, b + off)) < 16) return (int)a[off + i] - (int)b[off + i];
+    }
+    /* Overlapping tail: bytes already compared are known equal */
+    if (off < n) {
+        off = n - 16;
+        if ((i = diff16(a + off, b + off)) < 16) return (int)a[off + i] - (int)b[off + i];
+    }
+    return 0;
+}
+
+AVX2 static int memcmp_avx2(const void *s1, const void *s2, size_t n)
+{
+    const uint8_t *a = (const uint8_t *)s1;
+    const uint8_t *b = (const uint8_t *)s2;
+
+    if (n < 32) return memcmp_sse2(a, b, n);
+
+    size_t off = 0;
+    for (;;) {
+        if (off + 32 > n) {
+            if (off == n) return 0;
+            off = n - 32;
+        }
+        __m256i x = _mm256_loadu_si256((const __m256i *)(a + off));
+        __m256i y = _mm256_loadu_si256((const __m256i *)(b + off));
+        uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y));
+        if (mask) {
+            unsigned i = (unsigned)__builtin_ctz(mask);
+            return (int)a[off + i] - (int)b[off + i];
+        }
+        if (off + 32 == n) return 0;
+        off += 32;
+    }
+}
+
+int k_memcmp(const void *s1, const void *s2, size_t n)
+{
+    if (vector_begin(n)) {
+        int r = memcmp_impl(s1, s2, n);
+        kernel_fpu_end();
+        return r;
+    }
+    return memcmp_generic(s1, s2, n);
+}
+
+/* dest > src and the ranges overlap: copy from the end towards the start */
+static void memmove_back_generic(uint8_t *d, const uint8_t *s, size_t len)
+{
+    d += len;
+    s += len;
+    while (len >= 8) {
+        d -= 8;
+        s -= 8;
+        store64(d, load64(s));
+        len -= 8;
+    }
+    while (len--) {
+        *--d = *--s;
+    }
+}
+
+SSE2 static void memmove_back_sse2(uint8_t *d, const uint8_t *s, size_t len)
+{
+    if (len < 16) {
+        copy_small(d, s, len);
+        return;
+    }
+    /* The first 16 source bytes get overwritten last; grab them now */
+    __m128i head = _mm_loadu_si128((const __m128i *)s);
+    while (len >= 64) {
+        len -= 64;
+        __m128i a = _mm_loadu_si128((const __m128i *)(s + len + 48));
+        __m128i b = _mm_loadu_si128((const __m128i *)(s + len + 32));
+        __m128i c = _mm_loadu_si128((const __m128i *)(s + len + 16));
+        __m128i e = _mm_loadu_si128((const __m128i *)(s + len));
+        _mm_storeu_si128((__m128i *)(d + len + 48), a);
+        _mm_storeu_si128((__m128i *)(d + len + 32), b);
+        _mm_storeu_si128((__m128i *)(d + len + 16), c);
+        _mm_storeu_si128((__m128i *)(d + len), e);
+    }
+    while (len >= 16) {
+        len -= 16;
+        _mm_storeu_si128((__m128i *)(d + len), _mm_loadu_si128((const __m128i *)(s + len)));
+    }
+    _mm_storeu_si128((__m128i *)d, head);
+}
+
+AVX2 static void memmove_back_avx2(uint8_t *d, const uint8_t *s, size_t len)
+{
+    if (len < 32) {
+        memmove_back_sse2(d, s, len);
+        return;
+    }
+    __m256i head = _mm256_loadu_si256((const __m256i *)s);
+    while (len >= 128) {
+        len -= 128;
+        __m256i a = _mm256_loadu_si256((const __m256i *)(s + len + 96));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(s + len + 64));
+        __m256i c = _mm256_loadu_si256((const __m256i *)(s + len + 32));
+        __m256i e = _mm256_loadu_si256((const __m256i *)(s + len));
+        _mm256_storeu_si256((__m256i *)(d + len + 96), a);
+        _mm256_storeu_si256((__m256i *)(d + len + 64), b);
+        _mm256_storeu_si256((__m256i *)(d + len + 32), c);
+        _mm256_storeu_si256((__m256i *)(d + len), e);
+    }
+    while (len >= 32) {
+        len -= 32;
+        _mm256_storeu_si256((__m256i *)(d + len), _mm256_loadu_si256((const __m256i *)(s + len)));
+    }
+    _mm256_storeu_si256((__m256i *)d, head);
+}
+
 void k_memmove(void *dest, const void *src, size_t len)
 {
     if (!len || dest == src) return;
     uint8_t *d = (uint8_t *)dest;
     const uint8_t *s = (const uint8_t *)src;
-    if (d < s || d >= (s + len)) {
+    if (d >= (s + len) || s >= (d + len)) {
         k_memcpy(d, s, len);
         return;
     }
-    /* Overlap, copy backwards */
-    d += len;
-    s += len;
-    while (len--) {
-        *--d = *--s;
+    bool vec = vector_begin(len);
+    if (d < s) {
+        /* Forward copies load before they store, so dest < src is safe */
+        if (vec) memcpy_impl(d, s, len);
+        else memcpy_generic(d, s, len);
+    } else {
+        /* Overlap, copy backwards */
+        if (vec) memmove_back_impl(d, s, len);
+        else memmove_back_generic(d, s, len);
     }
+    if (vec) kernel_fpu_end();
 }
 
 char *k_strchr(const char *s, int c)
@@ -235,14 +650,19 @@ int k_atoi(const char *str)
     return (int)(result * sign);
 }
 
-size_t k_strlen(const char *src)
+/*
+ * Length of src if its end turns up in the first max bytes (or the word
+ * holding byte max); otherwise how many bytes were found to be non-zero.
+ */
+static size_t strscan_generic(const char *src, size_t max)
 {
     const char *s = src;
     /* Handle bytes until aligned */
     while (((uintptr_t)s & 0x7) && *s) s++;
+    if (*s == '\0') return (size_t)(s - src);
 
     const uint64_t *w = (const uint64_t *)s;
-    for (;;) {
+    while ((size_t)((const char *)w - src) < max) {
         uint64_t v = *w;
         /* magic to detect zero byte in word */
         if (((v - 0x0101010101010101ULL) & ~v & 0x8080808080808080ULL) != 0) {
@@ -253,6 +673,117 @@ size_t k_strlen(const char *src)
         }
         w++;
     }
+    return (size_t)((const char *)w - src);
+}
+
+static size_t strlen_generic(const char *src)
+{
+    return strscan_generic(src, SIZE_MAX);
+}
+
+/*
+ * Vector strlen only issues aligned loads, which never cross a page
+ * boundary; bytes before the start of the string are masked off.
+ */
+SSE2 static size_t strlen_sse2(const char *src)
+{
+    const __m128i zero = _mm_setzero_si128();
+    uintptr_t off = (uintptr_t)src & 15;
+    const __m128i *p = (const __m128i *)(src - off);
+
+    unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(p), zero)) >> off;
+    if (mask) return __builtin_ctz(mask);
+
+    for (;;) {
+        p++;
+        mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(p), zero));
+        if (mask) return (size_t)((const char *)p - src) + __builtin_ctz(mask);
+    }
+}
+
+AVX2 static size_t strlen_avx2(const char *src)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    uintptr_t off = (uintptr_t)src & 31;
+    const __m256i *p = (const __m256i *)(src - off);
+
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256(p), zero)) >> off;
+    if (mask) return __builtin_ctz(mask);
+
+    for (;;) {
+        p++;
+        mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256(p), zero));
+        if (mask) return (size_t)((const char *)p - src) + __builtin_ctz(mask);
+    }
+}
+
+/* Most strings end well short of VECTOR_THRESHOLD and never need the FPU */
+size_t k_strlen(const char *src)
+{
+    size_t n = strscan_generic(src, VECTOR_THRESHOLD);
+    if (src[n] == '\0') return n;
+
+    if (vector_begin(VECTOR_THRESHOLD)) {
+        n += strlen_impl(src + n);
+        kernel_fpu_end();
+        return n;
+    }
+    return n + strlen_generic(src + n);
+}
+
+void k_string_init(void)
+{
+    static const char *const names[3][3] = {
+        { "generic", "generic+erms", "generic+fsrm" },
+        { "sse2", "sse2+erms", "sse2+fsrm" },
+        { "avx2", "avx2+erms", "avx2+fsrm" },
+    };
+    int vec = 0;
+    int rep = 0;
+
+    memcpy_impl = memcpy_generic;
+    memset_impl = memset_generic;
+    memcmp_impl = memcmp_generic;
+    strlen_impl = strlen_generic;
+    memmove_back_impl = memmove_back_generic;
+    rep_movsb_threshold = SIZE_MAX;
+    rep_stosb_threshold = SIZE_MAX;
+    vector_ok = false;
+
+    if (cpu_features.avx2) {
+        memcpy_impl = memcpy_avx2;
+        memset_impl = memset_avx2;
+        memcmp_impl = memcmp_avx2;
+        strlen_impl = strlen_avx2;
+        memmove_back_impl = memmove_back_avx2;
+        vector_ok = true;
+        vec = 2;
+    } else if (cpu_features.sse2) {
+        memcpy_impl = memcpy_sse2;
+        memset_impl = memset_sse2;
+        memcmp_impl = memcmp_sse2;
+        strlen_impl = strlen_sse2;
+        memmove_back_impl = memmove_back_sse2;
+        vector_ok = true;
+        vec = 1;
+    }
+
+    /*
+     * Even with FSRM, the bench has rep movsb losing to the AVX2 loop from
+     * about 200 bytes to 1.5 KiB and winning only from 2 KiB, so both
+     * flavours switch at the same size.
+     */
+    if (cpu_features.fsrm || cpu_features.erms) {
+        rep_movsb_threshold = ERMS_THRESHOLD;
+        rep_stosb_threshold = ERMS_THRESHOLD;
+        rep = cpu_features.fsrm ? 2 : 1;
+    }
+    string_variant = names[vec][rep];
+}
+
+const char *k_string_variant(void)
+{
+    return string_variant;
 }
 
 char *k_strcpy(char *dest, const char *src)
@@ -0,0 +1,53 @@
+;
+; Copyright (C) 2025 Roy Roy123ty@hotmail.com
+;
+; This file is part of Solum OS
+;
+; This program is free software: you can redistribute it and/or modify
+; it under the terms of the GNU General Public License as published by
+; the Free Software Foundation, either version 3 of the License, or
+; (at your option) any later version.
+;
+; This program is distributed in the hope that it will be useful,
+; but WITHOUT ANY WARRANTY; without even the implied warranty of
+; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+; GNU General Public License for more details.
+;
+; You should have received a copy of the GNU General Public License
+; along with this program.  If not, see <http://www.gnu.org/licenses/>.
+;
+
+bits 64
+section .text
+
+global switch_to
+global thread_start
+extern thread_entry
+
+; void switch_to(uint64_t *prev_rsp, uint64_t next_rsp)
+; Called like any function, so only the callee-saved registers need to
+; survive; vector state is fpu_switch()'s business.
+switch_to:
+    push rbp
+    push rbx
+    push r12
+    push r13
+    push r14
+    push r15
+    mov [rdi], rsp
+    mov rsp, rsi
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop rbx
+    pop rbp
+    ret
+
+; A new thread's first switch_to() returns here with the function in
+; r12 and its argument in r13
+thread_start:
+    mov rdi, r12
+    mov rsi, r13
+    call thread_entry
+    ud2
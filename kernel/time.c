@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <kernel/acpi.h>
+#include <kernel/cpu.h>
+#include <kernel/paging.h>
+#include <kernel/port.h>
+#include <kernel/printk.h>
+#include <kernel/time.h>
+
+#define CALIBRATE_MS     10
+#define CALIBRATE_TRIES  3
+
+#define PIT_HZ           1193182
+#define PIT_CH2_DATA     0x42
+#define PIT_CMD          0x43
+#define PIT_GATE_PORT    0x61   // bit 0: channel 2 gate, bit 1: speaker, bit 5: channel 2 output
+
+#define HPET_CAP         0x00   // period in femtoseconds in the upper half
+#define HPET_CONFIG      0x10
+#define HPET_COUNTER     0xF0
+#define HPET_ENABLE      (1 << 0)
+#define FSEC_PER_NSEC    1000000ULL
+
+struct tsc_clock tsc_clock;
+
+static void tsc_set_khz(uint32_t khz)
+{
+    cpu_tsc_khz = khz;
+    tsc_clock.mult = (NSEC_PER_SEC << TSC_SHIFT) / ((uint64_t)khz * 1000);
+    tsc_clock.cyc_mult = ((uint64_t)khz << TSC_SHIFT) / 1000000;
+}
+
+// Length of a TSC interval in nanoseconds, 0 until the rate is known
+uint64_t cycles_to_ns(uint64_t cycles)
+{
+    return (uint64_t)(((unsigned __int128)cycles * tsc_clock.mult) >> TSC_SHIFT);
+}
+
+// Start the clock; printk timestamps use the CPUID-reported rate until tsc_init()
+void tsc_early_init(void)
+{
+    tsc_clock.base = rdtsc();
+    if (cpu_tsc_khz) tsc_set_khz(cpu_tsc_khz);
+}
+
+/*
+ * One-shot countdown on PIT channel 2 with the speaker off; its output
+ * goes high at terminal count. Returns the TSC cycles it took.
+ */
+static uint64_t pit_measure(void)
+{
+    uint16_t count = PIT_HZ * CALIBRATE_MS / 1000;
+
+    outb(PIT_GATE_PORT, (inb(PIT_GATE_PORT) & ~0x02) | 0x01);
+    outb(PIT_CMD, 0xB0);    // channel 2, lobyte/hibyte, mode 0
+    outb(PIT_CH2_DATA, count & 0xFF);
+    outb(PIT_CH2_DATA, count >> 8);
+
+    uint64_t start = rdtsc();
+    while (!(inb(PIT_GATE_PORT) & 0x20)) { }
+    return rdtsc() - start;
+}
+
+static uint32_t pit_calibrate(void)
+{
+    uint64_t best = UINT64_MAX;
+
+    // The shortest run had the fewest SMIs and port delays in it
+    for (int i = 0; i < CALIBRATE_TRIES; i++) {
+        uint64_t cycles = pit_measure();
+        if (cycles < best) best = cycles;
+    }
+    return (uint32_t)(best / CALIBRATE_MS);
+}
+
+static uint32_t hpet_calibrate(void)
+{
+    const struct acpi_hpet *table = (const struct acpi_hpet *)acpi_find_table("HPET");
+    if (!table || table->address.space_id != 0) return 0;
+
+    volatile uint64_t *hpet = ioremap(table->address.address, PAGE_SIZE, PAGE_UC);
+    if (!hpet) return 0;
+
+    uint64_t period = hpet[HPET_CAP / 8] >> 32;
+    if (!period) return 0;
+    hpet[HPET_CONFIG / 8] |= HPET_ENABLE;
+
+    uint64_t ticks = CALIBRATE_MS * 1000000 * FSEC_PER_NSEC / period;
+    uint64_t best = UINT64_MAX;
+    for (int i = 0; i < CALIBRATE_TRIES; i++) {
+        uint64_t h0 = hpet[HPET_COUNTER / 8];
+        uint64_t t0 = rdtsc();
+        uint64_t h1;
+        while ((h1 = hpet[HPET_COUNTER / 8]) - h0 < ticks) { }
+        uint64_t cycles = rdtsc() - t0;
+
+        // Scale to exactly CALIBRATE_MS, the last read overshoots a little
+        cycles = cycles * ticks / (h1 - h0);
+        if (cycles < best) best = cycles;
+    }
+    return (uint32_t)(best / CALIBRATE_MS);
+}
+
+/*
+ * Measure the TSC rate against the HPET, or the PIT without one, and
+ * switch the clock over to it. The CPUID value stays in use if neither
+ * gives a plausible answer.
+ */
+void tsc_init(void)
+{
+    const char *source = "HPET";
+    uint32_t khz = hpet_calibrate();
+    if (!khz) {
+        source = "PIT";
+        khz = pit_calibrate();
+    }
+
+    if (khz < 1000) {
+        printk(KERN_WARN "tsc: calibration against the %s failed\n", source);
+        if (!cpu_tsc_khz) printk(KERN_WARN "tsc: no rate known, timestamps stay at zero\n");
+        return;
+    }
+
+    // Keep the clock continuous across the rate change (fine for the first hour)
+    uint64_t now = tsc_to_ns(rdtsc());
+    tsc_set_khz(khz);
+    tsc_clock.base = rdtsc() - now * khz / 1000000;
+
+    printk("tsc: %u.%03u MHz, calibrated against the %s%s\n", khz / 1000, khz % 1000, source,
+           cpu_features.tsc_invariant ? "" : ", not invariant");
+}
@@ -0,0 +1,114 @@
+;
+; Copyright (C) 2025 Roy Roy123ty@hotmail.com
+;
+; This file is part of Solum OS
+;
+; This program is free software: you can redistribute it and/or modify
+; it under the terms of the GNU General Public License as published by
+; the Free Software Foundation, either version 3 of the License, or
+; (at your option) any later version.
+;
+; This program is distributed in the hope that it will be useful,
+; but WITHOUT ANY WARRANTY; without even the implied warranty of
+; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+; GNU General Public License for more details.
+;
+; You should have received a copy of the GNU General Public License
+; along with this program.  If not, see <http://www.gnu.org/licenses/>.
+;
+
+
+; Secondary CPUs start here in real mode. smp.c copies this code to
+; TRAMPOLINE_BASE and fills in trampoline_params; the boot CPU's control
+; registers are replayed so that both run in the same mode. The page
+; tables in cr3 identity map the trampoline and share the kernel half.
+
+TRAMPOLINE_BASE equ 0x8000      ; must match smp.c
+
+; Address of a trampoline symbol in the copy
+%define ABS(x) (TRAMPOLINE_BASE + (x) - trampoline_start)
+
+section .rodata
+align 16
+
+global trampoline_start
+global trampoline_end
+global trampoline_params
+
+bits 16
+trampoline_start:
+    cli
+    cld
+    xor ax, ax
+    mov ds, ax
+    lgdt [ABS(tr_gdtr)]
+    mov eax, cr0
+    or eax, 1
+    mov cr0, eax
+    jmp dword 0x08:ABS(tr_protected)
+
+bits 32
+tr_protected:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov ss, ax
+    mov eax, cr4
+    or eax, 1 << 5                  ; PAE
+    mov cr4, eax
+    mov eax, [ABS(trampoline_params.cr3)]
+    mov cr3, eax
+    mov ecx, 0xC0000080             ; EFER
+    rdmsr
+    or eax, [ABS(trampoline_params.efer)]
+    wrmsr
+    mov eax, [ABS(trampoline_params.cr0)]
+    mov cr0, eax                    ; paging on, long mode active
+    jmp 0x18:ABS(tr_long)
+
+bits 64
+tr_long:
+    mov rax, [ABS(trampoline_params.cr4)]
+    mov cr4, rax
+    test eax, 1 << 18               ; CR4.OSXSAVE
+    jz .no_xsave
+    mov eax, [ABS(trampoline_params.xcr0)]
+    mov edx, [ABS(trampoline_params.xcr0) + 4]
+    xor ecx, ecx
+    xsetbv
+.no_xsave:
+    fninit
+    mov rsp, [ABS(trampoline_params.stack)]
+    mov rdi, [ABS(trampoline_params.arg)]
+    mov rax, [ABS(trampoline_params.entry)]
+    call rax
+.halt:
+    cli
+    hlt
+    jmp .halt
+
+align 8
+tr_gdt:
+    dq 0
+    dq 0x00CF9A000000FFFF           ; 32-bit code
+    dq 0x00CF92000000FFFF           ; data
+    dq 0x0020980000000000           ; 64-bit code
+tr_gdt_end:
+
+tr_gdtr:
+    dw tr_gdt_end - tr_gdt - 1
+    dd ABS(tr_gdt)
+
+; Layout of struct trampoline_params in smp.c
+align 8
+trampoline_params:
+.cr3:   dq 0
+.efer:  dq 0
+.cr0:   dq 0
+.cr4:   dq 0
+.xcr0:  dq 0
+.stack: dq 0
+.entry: dq 0
+.arg:   dq 0
+
+trampoline_end:
@@ -20,84 +20,302 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <kernel/cpu.h>
+#include <kernel/idt.h>
+#include <kernel/lib/ring.h>
+#include <kernel/lib/string.h>
+#include <kernel/percpu.h>
+#include <kernel/preempt.h>
 #include <kernel/tty.h>
 #include <kernel/screen.h>
 #include <kernel/serial.h>
+#include <kernel/vsnprintf.h>
 
-#define TTY_BUFFER_SIZE 4096
+/*
+ * Every CPU appends to its own ring, so writers neither share a cache
+ * line nor wait for the console. A write becomes one record: a header
+ * word with the length and colours, a word with the record's global
+ * sequence number, then the text padded to 8 bytes. The sequence word
+ * is stored last, so a non-zero value means the record is complete;
+ * space the drainer hands back is zeroed to keep that true.
+ *
+ * One CPU at a time drains, taking whichever ring holds the next
+ * sequence number, so the console sees writes in the order they were
+ * made. Each record keeps its own colours, so any number of them can
+ * go out as one batch of runs. A full ring drops the new write and
+ * counts it, and the drainer reports the count instead of losing
+ * output silently.
+ */
+#define TTY_RING_SIZE 4096
+#define TTY_HDR_SIZE  16
+#define TTY_REC_MAX   (TTY_RING_SIZE / 4 - TTY_HDR_SIZE)   // longer writes are split
+#define TTY_BATCH     16                                    // records per console update
+
+/*
+ * ring.head is the end of reserved space, moved only by this CPU, and
+ * ring.tail the end of drained space, moved only by the drainer. The
+ * drainer reads ahead of tail and gives a batch back once it is shown.
+ * ring.buf stays NULL until the CPU first writes: the per-CPU template
+ * cannot hold a pointer into each CPU's own copy of data.
+ */
+struct tty_ring {
+    uint64_t dropped;   // bytes that did not fit
+    size_t read;        // next record for the drainer, at or past ring.tail
+    struct ring ring;
+    char data[TTY_RING_SIZE] __attribute__((aligned(64)));
+};
 
-static char tty_buffer[TTY_BUFFER_SIZE];
-static size_t tty_head = 0; // next write index  
-static size_t tty_tail = 0; // next read index  
-static vga_color_t tty_current_fore = LIGHT_GREY;
-static vga_color_t tty_current_back = BLACK;
+static DEFINE_PER_CPU(struct tty_ring, tty_ring);
+
+typedef char _tty_check[(TTY_RING_SIZE & (TTY_RING_SIZE - 1)) == 0 ? 1 : -1];
+
+static uint64_t tty_seq = 1;        // next sequence number to hand out
+static bool tty_draining;
+// Owned by whoever holds tty_draining
+static uint64_t tty_next = 1;       // next sequence number to drain
+static size_t tty_offset;           // bytes of that record tty_read() already took
+static uint64_t tty_dropped_seen;
+static unsigned int tty_last_cpu;   // where to start looking: runs of records share a CPU
+
+// Records are 8-byte aligned, so a header word never straddles the wrap
+static inline uint64_t *ring_word(struct ring *r, size_t pos)
+{
+    return (uint64_t *)ring_ptr(r, pos);
+}
 
-// Internal: amount of data currently in buffer  
-static inline size_t tty_count(void)
+static inline size_t rec_size(size_t len)
 {
-    return (tty_head - tty_tail) & (TTY_BUFFER_SIZE - 1);
+    return (TTY_HDR_SIZE + len + 7) & ~(size_t)7;
 }
 
 void tty_init(void)
 {
-    tty_head = 0;
-    tty_tail = 0;
     scr_init();
     srl_init();
 }
 
-typedef char _tty_check[(TTY_BUFFER_SIZE & (TTY_BUFFER_SIZE - 1)) == 0 ? 1 : -1];
+/*
+ * Append one record to this CPU's ring; the caller keeps preemption off.
+ * The space and the sequence number are taken together with interrupts
+ * off, so a handler's record can never sit in this ring ahead of one
+ * with a lower number. Filling it in runs with interrupts on.
+ */
+static bool ring_append(const char *buf, size_t len, vga_color_t fore, vga_color_t back)
+{
+    struct tty_ring *t = this_cpu_ptr(tty_ring);
+    struct ring *r = &t->ring;
+    size_t size = rec_size(len);
+
+    uint64_t flags = int_save();
+    if (!r->buf) ring_init(r, t->data, sizeof(t->data));
+    size_t pos = r->head;
+    if (size > ring_space(r)) {
+        int_restore(flags);
+        return false;
+    }
+    r->head = pos + size;
+    uint64_t seq = __atomic_fetch_add(&tty_seq, 1, __ATOMIC_RELAXED);
+    int_restore(flags);
+
+    *ring_word(r, pos) = len | (uint64_t)fore << 32 | (uint64_t)back << 40;
+    ring_write_at(r, pos + TTY_HDR_SIZE, buf, len);
+    __atomic_store_n(ring_word(r, pos + 8), seq, __ATOMIC_RELEASE);
+    return true;
+}
+
+/*
+ * The CPU whose ring holds the next record, complete, or MAX_CPUS if
+ * none does. Only reads, so tty_flush() can look after letting go.
+ */
+static unsigned int next_cpu(void)
+{
+    uint64_t next = __atomic_load_n(&tty_next, __ATOMIC_RELAXED);
+    unsigned int last = __atomic_load_n(&tty_last_cpu, __ATOMIC_RELAXED);
 
-void tty_set_color(vga_color_t fore, vga_color_t back)
+    for (unsigned int i = 0; i < MAX_CPUS; i++) {
+        unsigned int cpu = (last + i) % MAX_CPUS;
+        if (!percpu_offset[cpu]) continue;
+        struct tty_ring *t = per_cpu_ptr(tty_ring, cpu);
+        if (!__atomic_load_n(&t->ring.buf, __ATOMIC_ACQUIRE)) continue;
+        size_t read = __atomic_load_n(&t->read, __ATOMIC_RELAXED);
+        if (__atomic_load_n(ring_word(&t->ring, read + 8), __ATOMIC_ACQUIRE) == next) return cpu;
+    }
+    return MAX_CPUS;
+}
+
+// Drainer only: the ring to take the next record from, if it is complete
+static struct tty_ring *next_ring(void)
 {
-    tty_current_fore = fore;
-    tty_current_back = back;
+    unsigned int cpu = next_cpu();
+    if (cpu == MAX_CPUS) return NULL;
+    __atomic_store_n(&tty_last_cpu, cpu, __ATOMIC_RELAXED);
+    return per_cpu_ptr(tty_ring, cpu);
 }
 
-size_t tty_write(int fd, const char *buf, size_t len, vga_color_t fore, vga_color_t back)
+static inline size_t record_len(struct tty_ring *t)
+{
+    return (uint32_t)*ring_word(&t->ring, t->read);
+}
+
+static inline void record_done(struct tty_ring *t, size_t len)
+{
+    __atomic_store_n(&t->read, t->read + rec_size(len), __ATOMIC_RELAXED);
+    tty_offset = 0;
+    __atomic_store_n(&tty_next, tty_next + 1, __ATOMIC_RELAXED);
+}
+
+// Hand back everything read so far, zeroed so that it reads as incomplete
+static void ring_release(struct tty_ring *t)
+{
+    struct ring *r = &t->ring;
+    size_t size = t->read - r->tail;
+    size_t first = ring_span_at(r, r->tail, size);
+    k_memset(ring_ptr(r, r->tail), 0, first);
+    k_memset(r->buf, 0, size - first);
+    ring_consume(r, size);
+}
+
+/*
+ * Runs point straight into the rings, so records are only given back
+ * once their batch has been written. The screen is pushed out once per
+ * batch rather than once per record.
+ */
+static void drain_console(void)
+{
+    static struct scr_run runs[TTY_BATCH * 2];  // a record split by the wrap is two runs
+    static struct tty_ring *used[TTY_BATCH];
+    size_t nrecs;
+
+    do {
+        size_t nruns = 0;
+        struct tty_ring *t;
+
+        for (nrecs = 0; nrecs < TTY_BATCH && (t = next_ring()); nrecs++) {
+            struct ring *r = &t->ring;
+            uint64_t meta = *ring_word(r, t->read);
+            size_t len = (uint32_t)meta;
+            vga_color_t fore = (vga_color_t)((meta >> 32) & 0xFF);
+            vga_color_t back = (vga_color_t)((meta >> 40) & 0xFF);
+
+            size_t pos = t->read + TTY_HDR_SIZE + tty_offset;
+            size_t left = len - tty_offset;
+            while (left > 0) {
+                size_t span = ring_span_at(r, pos, left);
+                runs[nruns++] = (struct scr_run){ ring_ptr(r, pos), span, fore, back };
+                pos += span;
+                left -= span;
+            }
+            record_done(t, len);
+            used[nrecs] = t;
+        }
+        if (nruns) {
+            scr_write_runs(runs, nruns);
+            srl_write_runs(runs, nruns);
+        }
+        for (size_t i = 0; i < nrecs; i++) {
+            if (used[i]->read != used[i]->ring.tail) ring_release(used[i]);
+        }
+    } while (nrecs == TTY_BATCH);
+}
+
+static size_t drain_copy(char *dest, size_t len)
+{
+    struct tty_ring *t;
+    size_t done = 0;
+
+    while (done < len && (t = next_ring())) {
+        size_t rlen = record_len(t);
+        size_t n = rlen - tty_offset;
+        if (n > len - done) n = len - done;
+        ring_read_at(&t->ring, t->read + TTY_HDR_SIZE + tty_offset, dest + done, n);
+        done += n;
+        tty_offset += n;
+        if (tty_offset == rlen) {
+            record_done(t, rlen);
+            ring_release(t);
+        }
+    }
+    return done;
+}
+
+static void report_drops(void)
+{
+    uint64_t dropped = 0;
+
+    for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (percpu_offset[cpu]) dropped += __atomic_load_n(&per_cpu_ptr(tty_ring, cpu)->dropped, __ATOMIC_RELAXED);
+    }
+    if (dropped == tty_dropped_seen) return;
+
+    char msg[48];
+    int n = snprintf(msg, sizeof(msg), "[WARN] tty: %lu bytes dropped\n", dropped - tty_dropped_seen);
+    tty_dropped_seen = dropped;
+    struct scr_run run = { msg, (size_t)n, YELLOW, BLACK };
+    scr_write_runs(&run, 1);
+    srl_write_runs(&run, 1);
+}
+
+/*
+ * Queue without writing anything out, for callers that put out several
+ * records and then call tty_flush() once. Returns how much was queued:
+ * when this CPU's ring is full it tries one flush to make room, and
+ * whatever still does not fit is counted as dropped.
+ */
+size_t tty_queue(const char *buf, size_t len, vga_color_t fore, vga_color_t back)
 {
-    (void)fd;
-    tty_set_color(fore, back);
     size_t written = 0;
-    for (size_t i = 0; i < len; i++) {
-        unsigned char c = (unsigned char)*(buf + i);
-        size_t next = (tty_head + 1) & (TTY_BUFFER_SIZE - 1);
-        if (next == tty_tail) {
-            tty_tail = (tty_tail + 1) & (TTY_BUFFER_SIZE - 1);
+    bool flushed = false;
+
+    while (written < len) {
+        size_t n = len - written < TTY_REC_MAX ? len - written : TTY_REC_MAX;
+        preempt_disable();
+        bool ok = ring_append(buf + written, n, fore, back);
+        preempt_enable();
+        if (ok) {
+            written += n;
+        } else if (!flushed) {
+            tty_flush();
+            flushed = true;
+        } else {
+            this_cpu_add(tty_ring.dropped, len - written);
+            break;
         }
-        tty_buffer[tty_head] = (char)c;
-        tty_head = next;
-        written++;
     }
+    return written;
+}
 
+size_t tty_write(int fd, const char *buf, size_t len, vga_color_t fore, vga_color_t back)
+{
+    (void)fd;
+    size_t written = tty_queue(buf, len, fore, back);
     tty_flush();
     return written;
 }
 
 size_t tty_read(char *dest, size_t len)
 {
-    size_t available = tty_count();
-    size_t to_read = (len < available) ? len : available;
-    for (size_t i = 0; i < to_read; i++) {
-        dest[i] = tty_buffer[tty_tail];
-        tty_tail = (tty_tail + 1) & (TTY_BUFFER_SIZE - 1);
-    }
-    return to_read;
+    if (__atomic_exchange_n(&tty_draining, true, __ATOMIC_ACQUIRE)) return 0;
+    preempt_disable();
+    size_t n = drain_copy(dest, len);
+    __atomic_store_n(&tty_draining, false, __ATOMIC_SEQ_CST);
+    preempt_enable();
+    return n;
 }
 
+/*
+ * Whoever finds the console busy leaves its records to the CPU already
+ * draining. That CPU looks again after letting go, in case a record was
+ * completed just as it finished; the look only reads, since the drain
+ * cursors belong to whoever takes tty_draining next.
+ */
 void tty_flush(void)
 {
-    char tmp[256];
-    size_t cnt = tty_count();
-    while (cnt > 0) {
-        size_t to_copy = (cnt < sizeof(tmp)) ? cnt : sizeof(tmp);
-        for (size_t i = 0; i < to_copy; i++) {
-            tmp[i] = tty_buffer[tty_tail];
-            tty_tail = (tty_tail + 1) & (TTY_BUFFER_SIZE - 1);
-        }
-        scr_write(tmp, to_copy, tty_current_fore, tty_current_back);
-        srl_write(tmp, to_copy);
-
-        cnt = tty_count();
-    }
+    do {
+        if (__atomic_exchange_n(&tty_draining, true, __ATOMIC_ACQUIRE)) return;
+        preempt_disable();
+        drain_console();
+        report_drops();
+        __atomic_store_n(&tty_draining, false, __ATOMIC_SEQ_CST);
+        preempt_enable();
+    } while (next_cpu() != MAX_CPUS);
 }
@@ -0,0 +1,549 @@
+/*
+ * Copyright (C) 2025 Roy Roy123ty@hotmail.com
+ *
+ * This file is part of Solum OS
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <kernel/apic.h>
+#include <kernel/cpu.h>
+#include <kernel/idt.h>
+#include <kernel/paging.h>
+#include <kernel/pmm.h>
+#include <kernel/preempt.h>
+#include <kernel/printk.h>
+#include <kernel/slab.h>
+#include <kernel/smp.h>
+#include <kernel/vmm.h>
+
+#define MSR_EFER     0xC0000080
+#define EFER_NXE     (1 << 11)
+
+#define CR4_PGE      (1 << 7)
+#define CR4_PCIDE    (1 << 17)
+
+#define CR3_NOFLUSH  (1ULL << 63)
+#define MAX_PCID     4096
+
+#define INVPCID_ALL_GLOBAL 2
+
+#define KERNEL_SLOT  256 // first PML4 slot of the kernel half
+
+struct address_space kernel_space;
+
+static DEFINE_PER_CPU(struct address_space *, current_space);
+static uint64_t pcid_map[MAX_PCID / 64];
+static bool pcid_on;
+static bool nx_on;
+
+// A flush the other CPUs are asked to carry out, see tlb_shootdown()
+struct tlb_request {
+    struct address_space *as;
+    const uint64_t *addr;
+    unsigned int nr;
+    bool flush_all;
+    bool write_back;    // wbinvd first, for memory type changes
+};
+
+static struct tlb_request tlb_req;
+static uint64_t tlb_pending;    // CPUs yet to carry out tlb_req
+static bool tlb_busy;           // tlb_req is in use
+
+// Levels count up from the page table (1) to the PML4 (4)
+static inline uint64_t level_size(int level)
+{
+    return 1ULL << (PAGE_SHIFT + 9 * (level - 1));
+}
+
+static inline unsigned int level_index(uint64_t virt, int level)
+{
+    return (virt >> (PAGE_SHIFT + 9 * (level - 1))) & 511;
+}
+
+static inline bool level_has_leaves(int level)
+{
+    return level <= 2 || (level == 3 && cpu_features.pdpe1gb);
+}
+
+static uint64_t prot_bits(unsigned int prot, int level)
+{
+    uint64_t bits = PTE_PRESENT | pte_cache_bits((prot >> 4) & 3);
+
+    if (prot & VM_WRITE) bits |= PTE_WRITE;
+    if (prot & VM_USER) bits |= PTE_USER;
+    else bits |= PTE_GLOBAL;
+    if (!(prot & VM_EXEC) && nx_on) bits |= PTE_NX;
+    if (level > 1) bits |= PTE_HUGE;
+    return bits;
+}
+
+static uint64_t as_lock(struct address_space *as)
+{
+    return spin_lock_irqsave(&as->lock);
+}
+
+static void as_unlock(struct address_space *as, uint64_t flags)
+{
+    spin_unlock_irqrestore(&as->lock, flags);
+}
+
+/*
+ * Flush every translation of every PCID, global ones included. Toggling
+ * CR4.PGE does that where INVPCID is missing.
+ */
+void flush_tlb_all(void)
+{
+    if (pcid_on && cpu_features.invpcid) {
+        invpcid(INVPCID_ALL_GLOBAL, 0, 0);
+        return;
+    }
+
+    uint64_t cr4 = read_cr4();
+    if (cr4 & CR4_PGE) {
+        write_cr4(cr4 & ~CR4_PGE);
+        write_cr4(cr4);
+    } else {
+        write_cr3(read_cr3());
+    }
+}
+
+// Carry out tlb_req if this CPU is among those it was sent to
+static void tlb_serve(void)
+{
+    uint64_t bit = 1ULL << cpu_id();
+    if (!(__atomic_load_n(&tlb_pending, __ATOMIC_ACQUIRE) & bit)) return;
+
+    if (tlb_req.write_back) asm volatile ("wbinvd" ::: "memory");
+    if (tlb_req.as == &kernel_space) {
+        if (tlb_req.flush_all) flush_tlb_all();
+        else for (unsigned int i = 0; i < tlb_req.nr; i++) invlpg(tlb_req.addr[i]);
+    } else if (tlb_req.as == this_cpu_read(current_space)) {
+        if (tlb_req.flush_all) write_cr3(read_cr3());
+        else for (unsigned int i = 0; i < tlb_req.nr; i++) invlpg(tlb_req.addr[i]);
+    }
+    __atomic_fetch_and(&tlb_pending, ~bit, __ATOMIC_RELEASE);
+}
+
+static void tlb_ipi(struct int_frame *frame)
+{
+    (void)frame;
+    tlb_serve();
+    lapic_eoi();
+}
+
+/*
+ * Have every other online CPU carry out req and wait until all have.
+ * One request is out at a time. A CPU waiting to send serves the
+ * current one by polling, so two senders never wait on each other, and
+ * neither do senders with interrupts off. The caller must not hold a
+ * spinlock, since a CPU spinning on it with interrupts off would never
+ * take the IPI.
+ */
+static void tlb_shootdown(const struct tlb_request *req)
+{
+    unsigned int cpus = __atomic_load_n(&nr_cpus, __ATOMIC_ACQUIRE);
+    if (cpus <= 1) return;
+
+    preempt_disable();
+    while (__atomic_exchange_n(&tlb_busy, true, __ATOMIC_ACQUIRE)) {
+        tlb_serve();
+        asm volatile ("pause");
+    }
+
+    tlb_req = *req;
+    uint64_t others = (cpus == 64 ? ~0ULL : (1ULL << cpus) - 1) & ~(1ULL << cpu_id());
+    __atomic_store_n(&tlb_pending, others, __ATOMIC_RELEASE);
+    for (uint64_t m = others; m; m &= m - 1) {
+        lapic_send_vector(*per_cpu_ptr(cpu_apic_id, __builtin_ctzll(m)), TLB_VECTOR);
+    }
+    while (__atomic_load_n(&tlb_pending, __ATOMIC_ACQUIRE)) asm volatile ("pause");
+
+    __atomic_store_n(&tlb_busy, false, __ATOMIC_RELEASE);
+    preempt_enable();
+}
+
+// flush_tlb_all() on every online CPU, after writing back caches if asked
+void flush_tlb_all_cpus(bool write_back)
+{
+    struct tlb_request req = { .as = &kernel_space, .flush_all = true, .write_back = write_back };
+
+    if (write_back) asm volatile ("wbinvd" ::: "memory");
+    flush_tlb_all();
+    tlb_shootdown(&req);
+}
+
+void tlb_gather_init(struct mmu_gather *tlb, struct address_space *as)
+{
+    tlb->as = as;
+    tlb->nr = 0;
+    tlb->flush_all = false;
+    tlb->freed_tables = false;
+    tlb->free_list = 0;
+    tlb->irq_flags = as_lock(as);
+}
+
+// One invlpg covers a leaf of any size
+static void tlb_gather_add(struct mmu_gather *tlb, uint64_t virt)
+{
+    if (tlb->flush_all) return;
+    if (tlb->nr == MMU_GATHER_MAX) {
+        tlb->flush_all = true;
+        return;
+    }
+    tlb->addr[tlb->nr++] = virt;
+}
+
+static void tlb_gather_free_table(struct mmu_gather *tlb, uint64_t *table)
+{
+    table[0] = tlb->free_list;
+    tlb->free_list = virt_to_phys(table);
+    tlb->freed_tables = true;
+}
+
+static void flush_pages(struct mmu_gather *tlb)
+{
+    for (unsigned int i = 0; i < tlb->nr; i++) {
+        invlpg(tlb->addr[i]);
+    }
+}
+
+/*
+ * Kernel mappings are global and shared by every address space: invlpg
+ * drops them for all PCIDs, but freed tables may still sit in other
+ * PCIDs' paging-structure caches. A user address space keeps entries
+ * tagged with its PCID on every CPU that ran it, so each of those is
+ * marked stale and flushes on its next vmm_switch(); only a CPU that
+ * has it loaded and flushed here stays clean. Other CPUs are flushed by
+ * IPI once the lock is dropped, and freed tables only go back to the
+ * PMM after that, since those CPUs may still walk them.
+ */
+void tlb_gather_finish(struct mmu_gather *tlb)
+{
+    struct address_space *as = tlb->as;
+
+    bool pending = tlb->nr || tlb->flush_all;
+    bool kernel_all = tlb->flush_all || (tlb->freed_tables && pcid_on);
+
+    if (pending && as == &kernel_space) {
+        if (kernel_all) flush_tlb_all();
+        else flush_pages(tlb);
+    } else if (pending && as != this_cpu_read(current_space)) {
+        __atomic_store_n(&as->stale, ~0ULL, __ATOMIC_RELEASE);
+    } else if (pending) {
+        __atomic_fetch_or(&as->stale, ~(1ULL << cpu_id()), __ATOMIC_RELEASE);
+        if (tlb->flush_all) write_cr3(read_cr3()); // this PCID only, globals stay
+        else flush_pages(tlb);
+    }
+
+    as_unlock(as, tlb->irq_flags);
+
+    if (pending) {
+        struct tlb_request req = {
+            .as = as,
+            .addr = tlb->addr,
+            .nr = tlb->nr,
+            .flush_all = as == &kernel_space ? kernel_all : tlb->flush_all,
+        };
+        tlb_shootdown(&req);
+    }
+
+    while (tlb->free_list) {
+        uint64_t phys = tlb->free_list;
+        tlb->free_list = *(uint64_t *)phys_to_virt(phys);
+        pmm_free_page(phys);
+    }
+}
+
+static bool table_empty(const uint64_t *table)
+{
+    for (int i = 0; i < 512; i++) {
+        if (table[i]) return false;
+    }
+    return true;
+}
+
+static uint64_t table_flags(struct address_space *as)
+{
+    return PTE_PRESENT | PTE_WRITE | (as == &kernel_space ? 0 : PTE_USER);
+}
+
+bool vmm_map(struct address_space *as, uint64_t virt, uint64_t phys, size_t size, unsigned int prot)
+{
+    if ((virt | phys | size) & (PAGE_SIZE - 1)) return false;
+
+    struct mmu_gather tlb;
+    uint64_t end = virt + size;
+    uint64_t tflags = table_flags(as);
+    bool ok = true;
+
+    tlb_gather_init(&tlb, as);
+    while (virt < end) {
+        uint64_t *table = as->pml4;
+        for (int level = 4; ; level--) {
+            uint64_t *entry = &table[level_index(virt, level)];
+            uint64_t step = level_size(level);
+
+            // A leaf fits if aligned and nothing but a leaf is there already
+            if (level_has_leaves(level) && !((virt | phys) & (step - 1)) && end - virt >= step &&
+                (level == 1 || !(*entry & PTE_PRESENT) || (*entry & PTE_HUGE))) {
+                if (*entry & PTE_PRESENT) tlb_gather_add(&tlb, virt);
+                *entry = phys | prot_bits(prot, level);
+                virt += step;
+                phys += step;
+                break;
+            }
+
+            if (!(*entry & PTE_PRESENT)) {
+                uint64_t next = pmm_alloc_page(PMM_ZERO);
+                if (!next) { ok = false; goto out; }
+                *entry = next | tflags;
+            } else if (*entry & PTE_HUGE) {
+                if (!split_large_page(entry, step)) { ok = false; goto out; }
+                *entry |= tflags;
+            }
+            table = table_at(*entry);
+        }
+    }
+
+out:
+    tlb_gather_finish(&tlb);
+    return ok;
+}
+
+/*
+ * Unmap (leaf == 0) or reprotect the leaves of [virt, end) below one
+ * entry of the given level. Large pages only partly inside the range
+ * are split first; tables an unmap leaves empty are freed, except the
+ * PDPTs which the kernel half shares between address spaces.
+ */
+static bool change_range(struct mmu_gather *tlb, uint64_t *table, int level,
+                         uint64_t virt, uint64_t end, unsigned int prot, bool unmap)
+{
+    uint64_t step = level_size(level);
+
+    while (virt < end) {
+        uint64_t next = (virt + step) & ~(step - 1);
+        if (next > end || next == 0) next = end;
+
+        uint64_t *entry = &table[level_index(virt, level)];
+        if (*entry & PTE_PRESENT) {
+            bool leaf = level == 1 || (*entry & PTE_HUGE);
+            if (leaf && next - virt == step) {
+                *entry = unmap ? 0 : (*entry & PTE_ADDR) | prot_bits(prot, level);
+                tlb_gather_add(tlb, virt);
+            } else {
+                if (leaf) {
+                    if (!split_large_page(entry, step)) return false;
+                    *entry |= table_flags(tlb->as);
+                }
+
+                uint64_t *child = table_at(*entry);
+                if (!change_range(tlb, child, level - 1, virt, next, prot, unmap)) return false;
+                if (unmap && level <= 3 && table_empty(child)) {
+                    *entry = 0;
+                    tlb_gather_free_table(tlb, child);
+                }
+            }
+        }
+        virt = next;
+    }
+    return true;
+}
+
+bool tlb_gather_unmap(struct mmu_gather *tlb, uint64_t virt, size_t size)
+{
+    if ((virt | size) & (PAGE_SIZE - 1)) return false;
+    return change_range(tlb, tlb->as->pml4, 4, virt, virt + size, 0, true);
+}
+
+bool vmm_unmap(struct address_space *as, uint64_t virt, size_t size)
+{
+    struct mmu_gather tlb;
+
+    tlb_gather_init(&tlb, as);
+    bool ok = tlb_gather_unmap(&tlb, virt, size);
+    tlb_gather_finish(&tlb);
+    return ok;
+}
+
+bool vmm_protect(struct address_space *as, uint64_t virt, size_t size, unsigned int prot)
+{
+    if ((virt | size) & (PAGE_SIZE - 1)) return false;
+
+    struct mmu_gather tlb;
+
+    tlb_gather_init(&tlb, as);
+    bool ok = change_range(&tlb, as->pml4, 4, virt, virt + size, prot, false);
+    tlb_gather_finish(&tlb);
+    return ok;
+}
+
+bool vmm_translate(struct address_space *as, uint64_t virt, uint64_t *phys)
+{
+    uint64_t *table = as->pml4;
+
+    for (int level = 4; level >= 1; level--) {
+        uint64_t entry = table[level_index(virt, level)];
+        if (!(entry & PTE_PRESENT)) return false;
+        if (level == 1 || (entry & PTE_HUGE)) {
+            uint64_t mask = level_size(level) - 1;
+            *phys = (entry & PTE_ADDR & ~mask) | (virt & mask);
+            return true;
+        }
+        table = table_at(entry);
+    }
+    return false;
+}
+
+static uint16_t pcid_alloc(void)
+{
+    for (unsigned int i = 0; i < MAX_PCID / 64; i++) {
+        uint64_t free = ~__atomic_load_n(&pcid_map[i], __ATOMIC_RELAXED);
+        while (free) {
+            unsigned int bit = __builtin_ctzll(free);
+            if (!(__atomic_fetch_or(&pcid_map[i], 1ULL << bit, __ATOMIC_RELAXED) & (1ULL << bit))) {
+                return (uint16_t)(i * 64 + bit);
+            }
+            free &= free - 1;
+        }
+    }
+    return 0; // shared with the kernel: flushed on every switch
+}
+
+// A new address space shares the kernel half, whose PDPTs vmm_init() allocated up front
+struct address_space *vmm_create(void)
+{
+    struct address_space *as = kzalloc(sizeof(*as));
+    if (!as) return NULL;
+
+    uint64_t pml4 = pmm_alloc_page(PMM_ZERO);
+    if (!pml4) {
+        kfree(as);
+        return NULL;
+    }
+
+    spin_lock_init(&as->lock);
+    as->pml4 = phys_to_virt(pml4);
+    for (int i = KERNEL_SLOT; i < 512; i++) {
+        as->pml4[i] = kernel_space.pml4[i];
+    }
+
+    as->pcid = pcid_on ? pcid_alloc() : 0;
+    as->stale = ~0ULL; // the PCID may have been used before, on any CPU
+    return as;
+}
+
+static void free_tables(uint64_t *table, int level)
+{
+    for (int i = 0; i < 512; i++) {
+        if ((table[i] & PTE_PRESENT) && !(table[i] & PTE_HUGE) && level > 1) {
+            free_tables(table_at(table[i]), level - 1);
+        }
+    }
+    pmm_free_page(virt_to_phys(table));
+}
+
+// The caller must already have switched every CPU away from it
+void vmm_destroy(struct address_space *as)
+{
+    for (int i = 0; i < KERNEL_SLOT; i++) {
+        if (as->pml4[i] & PTE_PRESENT) free_tables(table_at(as->pml4[i]), 3);
+    }
+    pmm_free_page(virt_to_phys(as->pml4));
+
+    if (as->pcid) {
+        __atomic_fetch_and(&pcid_map[as->pcid / 64], ~(1ULL << (as->pcid % 64)), __ATOMIC_RELAXED);
+    }
+    kfree(as);
+}
+
+/*
+ * With PCIDs the old address space's entries stay in the TLB, tagged,
+ * and are reused when it is switched back in, unless it went stale on
+ * this CPU. Interrupts stay off until current_space is updated: a
+ * shootdown IPI for as that lands after this CPU's stale bit was
+ * cleared then finds as loaded and flushes it.
+ */
+void vmm_switch(struct address_space *as)
+{
+    uint64_t flags = int_save();
+    if (this_cpu_read(current_space) == as) {
+        int_restore(flags);
+        return;
+    }
+
+    uint64_t cr3 = virt_to_phys(as->pml4);
+    if (pcid_on) {
+        uint64_t bit = 1ULL << cpu_id();
+        cr3 |= as->pcid;
+        bool stale = __atomic_fetch_and(&as->stale, ~bit, __ATOMIC_ACQUIRE) & bit;
+        if (as->pcid && !stale) cr3 |= CR3_NOFLUSH;
+    }
+    write_cr3(cr3);
+    this_cpu_write(current_space, as);
+    int_restore(flags);
+}
+
+/*
+ * Adopt the tables paging_init() built as the kernel address space and
+ * turn on global pages, NX and PCIDs where the CPU has them. Every
+ * kernel-half PML4 slot gets its PDPT now so that address spaces created
+ * later see all future kernel mappings.
+ */
+void vmm_init(void)
+{
+    kernel_space.pml4 = table_at(read_cr3());
+    spin_lock_init(&kernel_space.lock);
+    this_cpu_write(current_space, &kernel_space);
+    pcid_map[0] = 1; // PCID 0 is the kernel's
+    int_register(TLB_VECTOR, tlb_ipi);
+
+    if (cpu_features.nx) {
+        wrmsr(MSR_EFER, rdmsr(MSR_EFER) | EFER_NXE);
+        nx_on = true;
+    }
+
+    uint64_t cr4 = read_cr4();
+    if (cpu_features.pge) cr4 |= CR4_PGE;
+    // PCIDs only pay off with the kernel in global pages
+    if (cpu_features.pcid && cpu_features.pge && !(read_cr3() & 0xFFF)) {
+        cr4 |= CR4_PCIDE;
+        pcid_on = true;
+    }
+    write_cr4(cr4);
+
+    for (int i = KERNEL_SLOT; i < 512; i++) {
+        if (kernel_space.pml4[i] & PTE_PRESENT) continue;
+        uint64_t pdpt = pmm_alloc_page(PMM_ZERO);
+        if (!pdpt) {
+            printk(KERN_ERR "vmm: out of memory for the kernel PDPTs\n");
+            break;
+        }
+        kernel_space.pml4[i] = pdpt | PTE_PRESENT | PTE_WRITE;
+    }
+
+    printk("vmm: PCID %s, NX %s, global pages %s\n", pcid_on ? "on" : "off",
+           nx_on ? "on" : "off", cpu_features.pge ? "on" : "off");
+}
+
+// Moves a secondary CPU, which inherits the control registers, off the boot trampoline's tables
+void vmm_init_cpu(void)
+{
+    write_cr3(virt_to_phys(kernel_space.pml4));
+    this_cpu_write(current_space, &kernel_space);
+}
@@ -24,109 +24,464 @@
 #include <kernel/lib/string.h>
 #include <kernel/vsnprintf.h>
 
-int vsnprintf(char *out, size_t out_sz, const char *fmt, va_list args)
+#define FMT_LEFT  0x01  // '-'
+#define FMT_ZERO  0x02  // '0'
+#define FMT_PLUS  0x04  // '+'
+#define FMT_SPACE 0x08  // ' '
+#define FMT_ALT   0x10  // '#'
+
+#define FMT_NONE  (-1)  // no width/precision given
+#define FMT_STAR  (-2)  // width/precision taken from the argument list
+
+enum fmt_length {
+    LEN_INT,
+    LEN_LONG,
+    LEN_LLONG,
+    LEN_SIZE,
+};
+
+struct fmt_spec {
+    uint8_t flags;
+    uint8_t length;
+    char conv;
+    int width;
+    int precision;
+};
+
+struct fmt_out {
+    char *o;
+    size_t rem;
+};
+
+static const char digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const char hex_lower[] = "0123456789abcdef";
+static const char hex_upper[] = "0123456789ABCDEF";
+
+/* Most literal runs and fields are short; skip the k_mem* call for those */
+#define OUT_INLINE_MAX 16
+
+static inline void out_mem(struct fmt_out *out, const char *s, size_t n)
+{
+    if (n > out->rem) n = out->rem;
+    if (n <= OUT_INLINE_MAX) {
+        for (size_t i = 0; i < n; i++) out->o[i] = s[i];
+    } else {
+        k_memcpy(out->o, s, n);
+    }
+    out->o += n;
+    out->rem -= n;
+}
+
+static inline void out_fill(struct fmt_out *out, char c, size_t n)
+{
+    if (n > out->rem) n = out->rem;
+    if (n <= OUT_INLINE_MAX) {
+        for (size_t i = 0; i < n; i++) out->o[i] = c;
+    } else {
+        k_memset(out->o, (uint8_t)c, n);
+    }
+    out->o += n;
+    out->rem -= n;
+}
+
+static inline void out_char(struct fmt_out *out, char c)
+{
+    if (out->rem) {
+        *out->o++ = c;
+        out->rem--;
+    }
+}
+
+static inline int dec_digits(uint64_t v)
+{
+    int n = 1;
+    for (;;) {
+        if (v < 10) return n;
+        if (v < 100) return n + 1;
+        if (v < 1000) return n + 2;
+        if (v < 10000) return n + 3;
+        v /= 10000;
+        n += 4;
+    }
+}
+
+static inline int hex_digits(uint64_t v)
+{
+    return v ? (67 - __builtin_clzll(v)) / 4 : 1;
+}
+
+/* Write the digits of v so that the last one lands just before end */
+static inline void put_dec(char *end, uint64_t v)
+{
+    while (v >= 100) {
+        unsigned r = (unsigned)(v % 100);
+        v /= 100;
+        end -= 2;
+        end[0] = digit_pairs[r * 2];
+        end[1] = digit_pairs[r * 2 + 1];
+    }
+    if (v >= 10) {
+        end -= 2;
+        end[0] = digit_pairs[v * 2];
+        end[1] = digit_pairs[v * 2 + 1];
+    } else {
+        *--end = (char)('0' + v);
+    }
+}
+
+static void emit_dec(struct fmt_out *out, uint64_t v, int ndigits)
+{
+    if ((size_t)ndigits <= out->rem) {
+        put_dec(out->o + ndigits, v);
+        out->o += ndigits;
+        out->rem -= ndigits;
+        return;
+    }
+    /* Truncated output: only the leading digits fit */
+    char tmp[20];
+    put_dec(tmp + ndigits, v);
+    out_mem(out, tmp, (size_t)ndigits);
+}
+
+static void emit_hex(struct fmt_out *out, uint64_t v, int ndigits, const char *digits)
+{
+    size_t n = ((size_t)ndigits < out->rem) ? (size_t)ndigits : out->rem;
+    int shift = (ndigits - 1) * 4;
+    for (size_t i = 0; i < n; i++, shift -= 4) {
+        out->o[i] = digits[(v >> shift) & 0xF];
+    }
+    out->o += n;
+    out->rem -= n;
+}
+
+/* [pad][sign][prefix][zeros][digits][pad] */
+static void format_number(struct fmt_out *out, const struct fmt_spec *spec, uint64_t v, bool negative)
+{
+    bool hex = (spec->conv == 'x' || spec->conv == 'X' || spec->conv == 'p');
+    const char *digits = (spec->conv == 'x') ? hex_lower : hex_upper;
+    char sign = 0;
+    const char *prefix = NULL;
+    int ndigits;
+
+    if (hex) {
+        ndigits = hex_digits(v);
+        if (spec->conv == 'p' || ((spec->flags & FMT_ALT) && v)) prefix = (spec->conv == 'X') ? "0X" : "0x";
+    } else {
+        ndigits = dec_digits(v);
+        if (negative) sign = '-';
+        else if (spec->flags & FMT_PLUS) sign = '+';
+        else if (spec->flags & FMT_SPACE) sign = ' ';
+    }
+
+    /* An explicit zero precision prints nothing for zero */
+    if (spec->precision == 0 && v == 0) ndigits = 0;
+
+    int zeros = (spec->precision > ndigits) ? spec->precision - ndigits : 0;
+    int len = ndigits + zeros + (sign ? 1 : 0) + (prefix ? 2 : 0);
+    int pad = (spec->width > len) ? spec->width - len : 0;
+
+    if ((spec->flags & FMT_ZERO) && !(spec->flags & FMT_LEFT) && spec->precision == FMT_NONE) {
+        zeros += pad;
+        pad = 0;
+    }
+
+    if (pad && !(spec->flags & FMT_LEFT)) out_fill(out, ' ', (size_t)pad);
+    if (sign) out_char(out, sign);
+    if (prefix) out_mem(out, prefix, 2);
+    if (zeros) out_fill(out, '0', (size_t)zeros);
+    if (ndigits) {
+        if (hex) emit_hex(out, v, ndigits, digits);
+        else emit_dec(out, v, ndigits);
+    }
+    if (pad && (spec->flags & FMT_LEFT)) out_fill(out, ' ', (size_t)pad);
+}
+
+static void format_string(struct fmt_out *out, const struct fmt_spec *spec, const char *s)
+{
+    size_t len;
+
+    if (!s) s = "(null)";
+    if (spec->precision >= 0) {
+        size_t max = (size_t)spec->precision;
+        for (len = 0; len < max && s[len]; len++);
+    } else {
+        len = k_strlen(s);
+    }
+
+    size_t pad = (spec->width > 0 && (size_t)spec->width > len) ? (size_t)spec->width - len : 0;
+    if (pad && !(spec->flags & FMT_LEFT)) out_fill(out, ' ', pad);
+    out_mem(out, s, len);
+    if (pad && (spec->flags & FMT_LEFT)) out_fill(out, ' ', pad);
+}
+
+static void format_char(struct fmt_out *out, const struct fmt_spec *spec, char c)
+{
+    size_t pad = (spec->width > 1) ? (size_t)spec->width - 1 : 0;
+    if (pad && !(spec->flags & FMT_LEFT)) out_fill(out, ' ', pad);
+    out_char(out, c);
+    if (pad && (spec->flags & FMT_LEFT)) out_fill(out, ' ', pad);
+}
+
+/* Parse "[flags][width][.precision][length]conv" following a '%' */
+static const char *parse_spec(const char *p, struct fmt_spec *spec)
+{
+    spec->flags = 0;
+    spec->width = FMT_NONE;
+    spec->precision = FMT_NONE;
+    spec->length = LEN_INT;
+
+    for (;;) {
+        switch (*p) {
+            case '-': spec->flags |= FMT_LEFT; p++; continue;
+            case '0': spec->flags |= FMT_ZERO; p++; continue;
+            case '+': spec->flags |= FMT_PLUS; p++; continue;
+            case ' ': spec->flags |= FMT_SPACE; p++; continue;
+            case '#': spec->flags |= FMT_ALT; p++; continue;
+        }
+        break;
+    }
+
+    if (*p == '*') {
+        spec->width = FMT_STAR;
+        p++;
+    } else if (*p >= '0' && *p <= '9') {
+        spec->width = 0;
+        while (*p >= '0' && *p <= '9') spec->width = spec->width * 10 + (*p++ - '0');
+    }
+
+    if (*p == '.') {
+        p++;
+        if (*p == '*') {
+            spec->precision = FMT_STAR;
+            p++;
+        } else {
+            spec->precision = 0;
+            while (*p >= '0' && *p <= '9') spec->precision = spec->precision * 10 + (*p++ - '0');
+        }
+    }
+
+    if (*p == 'l') {
+        p++;
+        spec->length = LEN_LONG;
+        if (*p == 'l') { p++; spec->length = LEN_LLONG; }
+    } else if (*p == 'z') {
+        p++;
+        spec->length = LEN_SIZE;
+    }
+
+    spec->conv = *p;
+    return p;
+}
+
+/*
+ * Arguments come either from a va_list or from words packed by
+ * vbin_printf(); the formatting loop below is shared by both.
+ */
+struct fmt_args {
+    va_list *va;
+    const uint64_t *bin;
+    size_t words;
+    size_t pos;
+};
+
+static inline uint64_t bin_next(struct fmt_args *a)
+{
+    return (a->pos < a->words) ? a->bin[a->pos++] : 0;
+}
+
+// '*' widths and precisions, and %c, are always passed as int
+static inline int arg_int(struct fmt_args *a)
+{
+    if (!a->va) return (int)bin_next(a);
+    return va_arg(*a->va, int);
+}
+
+static inline int64_t arg_signed(struct fmt_args *a, const struct fmt_spec *spec)
+{
+    if (!a->va) return (int64_t)bin_next(a);
+    if (spec->length == LEN_INT) return va_arg(*a->va, int);
+    return va_arg(*a->va, int64_t);
+}
+
+static inline uint64_t arg_unsigned(struct fmt_args *a, const struct fmt_spec *spec)
+{
+    if (!a->va) return bin_next(a);
+    if (spec->length == LEN_INT) return va_arg(*a->va, unsigned int);
+    return va_arg(*a->va, uint64_t);
+}
+
+static inline const char *arg_string(struct fmt_args *a)
+{
+    if (a->va) return va_arg(*a->va, const char *);
+    if (a->pos >= a->words) return NULL;
+
+    /* Packed strings are stored inline, NUL-terminated and word padded */
+    const char *s = (const char *)&a->bin[a->pos];
+    size_t len = k_strlen(s);
+    a->pos += len / 8 + 1;
+    return s;
+}
+
+static int format_args(char *out_buf, size_t out_sz, const char *fmt, struct fmt_args *a)
 {
-    char *o = out;
-    size_t rem = out_sz ? out_sz - 1 : 0; // leave space for NUL
+    struct fmt_out out = { out_buf, out_sz ? out_sz - 1 : 0 }; // leave space for NUL
     const char *p = fmt;
-    char tmp[64];
+    struct fmt_spec spec;
 
-    while (*p && rem) {
+    while (*p && out.rem) {
         if (*p != '%') {
-            *o++ = *p++;
-            rem--;
+            const char *lit = p;
+            while (*p && *p != '%') p++;
+            out_mem(&out, lit, (size_t)(p - lit));
             continue;
         }
-        p++; // skip %
-        int long_count = 0;
-        while (*p == 'l') { long_count++; p++; }
+        p = parse_spec(p + 1, &spec); // skip %
 
-        switch (*p) {
-            case 's': {
-                const char *s = va_arg(args, const char *);
-                if (!s) s = "(null)";
-                size_t l = k_strlen(s);
-                if (l > rem) l = rem;
-                for (size_t i = 0; i < l; i++) { *o++ = s[i]; }
-                rem -= l;
-                break;
+        if (spec.width == FMT_STAR) {
+            spec.width = arg_int(a);
+            if (spec.width < 0) {
+                spec.flags |= FMT_LEFT;
+                spec.width = -spec.width;
             }
-            case 'c': {
-                char c = (char)va_arg(args, int);
-                if (rem) { *o++ = c; rem--; }
+        }
+        if (spec.precision == FMT_STAR) {
+            spec.precision = arg_int(a);
+            if (spec.precision < 0) spec.precision = FMT_NONE;
+        }
+
+        switch (spec.conv) {
+            case 's':
+                format_string(&out, &spec, arg_string(a));
+                break;
+            case 'c':
+                format_char(&out, &spec, (char)arg_int(a));
                 break;
-            }
             case 'd': case 'i': {
-                if (long_count >= 2) {
-                    k_int64_to_string(va_arg(args, int64_t), tmp, sizeof(tmp));
-                } else if (long_count == 1) {
-                    k_int64_to_string((int64_t)va_arg(args, long), tmp, sizeof(tmp));
-                } else {
-                    k_int_to_string(va_arg(args, int), tmp, sizeof(tmp));
-                }
-                size_t l = k_strlen(tmp);
-                if (l > rem) l = rem;
-                for (size_t i = 0; i < l; i++) *o++ = tmp[i];
-                rem -= l;
+                int64_t v = arg_signed(a, &spec);
+                format_number(&out, &spec, v < 0 ? -(uint64_t)v : (uint64_t)v, v < 0);
                 break;
             }
-            case 'u': {
-                if (long_count >= 2) {
-                    k_uint64_to_string(va_arg(args, uint64_t), tmp, sizeof(tmp));
-                } else if (long_count == 1) {
-                    k_uint64_to_string((uint64_t)va_arg(args, unsigned long), tmp, sizeof(tmp));
-                } else {
-                    k_uint_to_string(va_arg(args, unsigned int), tmp, sizeof(tmp));
-                }
-                size_t l = k_strlen(tmp);
-                if (l > rem) l = rem;
-                for (size_t i = 0; i < l; i++) *o++ = tmp[i];
-                rem -= l;
+            case 'u': case 'x': case 'X':
+                format_number(&out, &spec, arg_unsigned(a, &spec), false);
+                break;
+            case 'p': {
+                struct fmt_spec ptr = spec;
+                ptr.length = LEN_LONG;
+                format_number(&out, &spec, arg_unsigned(a, &ptr), false);
                 break;
             }
-            case 'x': case 'X': {
-                bool upper = (*p == 'X');
-                if (long_count >= 2) {
-                    k_num_to_hexstr(va_arg(args, uint64_t), false, tmp, sizeof(tmp));
-                } else if (long_count == 1) {
-                    k_num_to_hexstr((uint64_t)va_arg(args, unsigned long), false, tmp, sizeof(tmp));
-                } else {
-                    k_num_to_hexstr((uint64_t)va_arg(args, unsigned int), false, tmp, sizeof(tmp));
-                }
-                if (!upper) {
-                    for (size_t i = 0; i < k_strlen(tmp); i++) {
-                        char c = tmp[i];
-                        if (c >= 'A' && c <= 'F') tmp[i] = c - 'A' + 'a';
-                    }
+            case '%':
+                out_char(&out, '%');
+                break;
+            default:
+                out_char(&out, '%');
+                if (spec.conv) out_char(&out, spec.conv);
+                break;
+        }
+        if (*p) p++;
+    }
+
+    if (out_sz) *out.o = '\0';
+    return (int)(out_sz ? (out_sz - 1 - out.rem) : 0);
+}
+
+int vsnprintf(char *out_buf, size_t out_sz, const char *fmt, va_list args)
+{
+    struct fmt_args a = { NULL, NULL, 0, 0 };
+    va_list va;
+
+    va_copy(va, args);
+    a.va = &va;
+    int len = format_args(out_buf, out_sz, fmt, &a);
+    va_end(va);
+    return len;
+}
+
+int snprintf(char *out_buf, size_t out_sz, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(out_buf, out_sz, fmt, args);
+    va_end(args);
+    return len;
+}
+
+size_t vbin_printf(uint64_t *bin, size_t words, const char *fmt, va_list args)
+{
+    const char *p = fmt;
+    struct fmt_spec spec;
+    size_t w = 0;
+
+    while (*p) {
+        if (*p != '%') {
+            p++;
+            continue;
+        }
+        p = parse_spec(p + 1, &spec);
+
+        if (spec.width == FMT_STAR) {
+            int v = va_arg(args, int);
+            if (w < words) bin[w++] = (uint64_t)(int64_t)v;
+        }
+        if (spec.precision == FMT_STAR) {
+            int v = va_arg(args, int);
+            if (w < words) bin[w++] = (uint64_t)(int64_t)v;
+            spec.precision = v;
+        }
+
+        switch (spec.conv) {
+            case 's': {
+                const char *s = va_arg(args, const char *);
+                if (w >= words) break;
+                if (!s) s = "(null)";
+
+                /* Copy the string itself: the caller's buffer may be gone by drain time */
+                char *dst = (char *)&bin[w];
+                size_t max = (words - w) * 8 - 1;
+                if (spec.precision >= 0 && (size_t)spec.precision < max) max = (size_t)spec.precision;
+                size_t len = 0;
+                while (len < max && s[len]) {
+                    dst[len] = s[len];
+                    len++;
                 }
-                size_t l = k_strlen(tmp);
-                if (l > rem) l = rem;
-                for (size_t i = 0; i < l; i++) *o++ = tmp[i];
-                rem -= l;
+                dst[len] = '\0';
+                w += len / 8 + 1;
                 break;
             }
-            case 'p': {
-                void *ptr = va_arg(args, void*);
-                k_num_to_hexstr((uint64_t)(uintptr_t)ptr, true, tmp, sizeof(tmp));
-                size_t l = k_strlen(tmp);
-                if (l > rem) l = rem;
-                for (size_t i = 0; i < l; i++) *o++ = tmp[i];
-                rem -= l;
+            case 'c': case 'd': case 'i': {
+                int64_t v = (spec.length == LEN_INT || spec.conv == 'c') ? va_arg(args, int) : va_arg(args, int64_t);
+                if (w < words) bin[w++] = (uint64_t)v;
                 break;
             }
-            case '%': {
-                if (rem) { *o++ = '%'; rem--; }
+            case 'u': case 'x': case 'X': {
+                uint64_t v = (spec.length == LEN_INT) ? va_arg(args, unsigned int) : va_arg(args, uint64_t);
+                if (w < words) bin[w++] = v;
                 break;
             }
-            default: {
-                if (rem) { *o++ = '%'; rem--; }
-                if (rem) { *o++ = *p; rem--; }
+            case 'p': {
+                void *v = va_arg(args, void *);
+                if (w < words) bin[w++] = (uint64_t)(uintptr_t)v;
                 break;
             }
         }
         if (*p) p++;
     }
+    return w;
+}
 
-    if (out_sz) *o = '\0';
-    return (int)(out_sz ? (out_sz - 1 - rem) : 0);
+int bstr_printf(char *out_buf, size_t out_sz, const char *fmt, const uint64_t *bin, size_t words)
+{
+    struct fmt_args a = { NULL, bin, words, 0 };
+    return format_args(out_buf, out_sz, fmt, &a);
 }